@@ -3,15 +3,44 @@
  * Description: Function pointer-based math operations with dynamic memory
  * Author: Student Submission
  * Date: November 2025
+ *
+ * Compilation: gcc -pthread Dynamic_Math_Data_Processing_Engine.c -o math_engine -lm
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REDUCTION_X86 1
+#else
+#define REDUCTION_X86 0
+#endif
 
 #define MAX_FILENAME 100
 
+// Sort engine: insertion sort below INSERTION_SORT_THRESHOLD elements,
+// introsort below RADIX_SORT_THRESHOLD, radix sort (3 passes of 11 bits)
+// above it, and a threaded radix sort plus merge from
+// PARALLEL_SORT_THRESHOLD up
+#define INSERTION_SORT_THRESHOLD 16
+#define RADIX_SORT_THRESHOLD 2048
+#define PARALLEL_SORT_THRESHOLD (1 << 21)
+#define MAX_SORT_THREADS 16
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES 3
+
+// Quantile selection: requested fractions per call, and the range size
+// above which pivots come from a Floyd-Rivest sample
+#define MAX_QUANTILES 32
+#define FLOYD_RIVEST_THRESHOLD 600
+
 // Function pointer type definitions
 typedef float (*MathOperation)(float*, int);
 typedef void (*SortOperation)(float*, int, int);
@@ -22,6 +51,29 @@ typedef struct {
     MathOperation operation;
 } Operation;
 
+// One thread's share of a parallel sort: a slice to sort (a), or the part
+// out[outBegin..outEnd) of the merge of runs a and b
+typedef struct {
+    float* a;
+    int lengthA;
+    float* b;
+    int lengthB;
+    float* out;
+    int outBegin;
+    int outEnd;
+} SortTask;
+
+// One implementation of the reduction kernels behind computeSum,
+// computeAverage, findMinimum, findMaximum and computeStdDev. Sums are
+// accumulated in double across several independent accumulators.
+typedef struct {
+    const char* name;
+    int (*supported)();
+    double (*sum)(const float*, int);
+    double (*sumSquaredDiff)(const float*, int, double);
+    void (*minMax)(const float*, int, float*, float*);
+} ReductionKernels;
+
 // Global dataset
 float* dataset = NULL;
 int dataSize = 0;
@@ -34,12 +86,58 @@ float findMaximum(float* data, int size);
 float findMinimum(float* data, int size);
 float computeMedian(float* data, int size);
 float computeStdDev(float* data, int size);
+float computeP95(float* data, int size);
+float computeP99(float* data, int size);
+float computeIQR(float* data, int size);
+float computeRange(float* data, int size);
+int computeQuantiles(float* data, int size, const double* fractions, float* results, int count, int inPlace);
+void multiSelect(float* data, int low, int high, const int* ranks, int firstRank, int lastRank, int depthLimit);
 
 // Function prototypes - Data Operations
 void sortAscending(float* data, int size, int dummy);
 void sortDescending(float* data, int size, int dummy);
 int searchValue(float* data, int size, float target);
 
+// Function prototypes - Reduction Kernels
+void selectReductionKernels();
+const ReductionKernels* activeKernels();
+int cpuHasScalar();
+double sumScalar(const float* data, int size);
+double sumSquaredDiffScalar(const float* data, int size, double mean);
+void minMaxScalar(const float* data, int size, float* min, float* max);
+void minMaxLanes(const float* lows, const float* highs, int lanes, const float* rest, int restSize, float* min, float* max);
+#if REDUCTION_X86
+int cpuHasSSE2();
+int cpuHasAVX2();
+int cpuHasAVX512();
+double sumSSE2(const float* data, int size);
+double sumSquaredDiffSSE2(const float* data, int size, double mean);
+void minMaxSSE2(const float* data, int size, float* min, float* max);
+double sumAVX2(const float* data, int size);
+double sumSquaredDiffAVX2(const float* data, int size, double mean);
+void minMaxAVX2(const float* data, int size, float* min, float* max);
+double sumAVX512(const float* data, int size);
+double sumSquaredDiffAVX512(const float* data, int size, double mean);
+void minMaxAVX512(const float* data, int size, float* min, float* max);
+#endif
+
+// Function prototypes - Sort Engine
+uint32_t floatKey(float value);
+float keyToFloat(uint32_t key);
+void introsortFloats(float* data, int size);
+void introsortRange(float* data, int low, int high, int depthLimit);
+void insertionSortFloats(float* data, int low, int high);
+void heapSortFloats(float* data, int size);
+void siftDownFloats(float* data, int root, int size);
+void swapFloats(float* data, int a, int b);
+int partitionFloats(float* data, int low, int high, int medianOfThree);
+int radixSortFloats(float* data, int size);
+int sortParallel(float* data, int size);
+void runSortTasks(pthread_t* threads, SortTask* tasks, int count, void* (*work)(void*));
+void* sortSliceTask(void* arg);
+void* mergeTask(void* arg);
+int mergePathSplit(const float* a, int lengthA, const float* b, int lengthB, int k);
+
 // Function prototypes - Memory Management
 void initializeDataset();
 void expandDataset();
@@ -71,20 +169,39 @@ Operation operations[] = {
     {"Maximum Value", findMaximum},
     {"Minimum Value", findMinimum},
     {"Median Value", computeMedian},
-    {"Standard Deviation", computeStdDev}
+    {"Standard Deviation", computeStdDev},
+    {"95th Percentile", computeP95},
+    {"99th Percentile", computeP99},
+    {"Interquartile Range", computeIQR},
+    {"Range (Max - Min)", computeRange}
 };
 
-int operationCount = 6;
+int operationCount = sizeof(operations) / sizeof(operations[0]);
+
+// Reduction kernels, widest first; the first one the CPU supports is used
+const ReductionKernels reductionKernelTable[] = {
+#if REDUCTION_X86
+    {"AVX-512", cpuHasAVX512, sumAVX512, sumSquaredDiffAVX512, minMaxAVX512},
+    {"AVX2", cpuHasAVX2, sumAVX2, sumSquaredDiffAVX2, minMaxAVX2},
+    {"SSE2", cpuHasSSE2, sumSSE2, sumSquaredDiffSSE2, minMaxSSE2},
+#endif
+    {"scalar", cpuHasScalar, sumScalar, sumSquaredDiffScalar, minMaxScalar}
+};
+
+int reductionKernelCount = sizeof(reductionKernelTable) / sizeof(reductionKernelTable[0]);
+const ReductionKernels* reductionKernels = NULL;
 
 // Main function
 int main() {
     int choice;
     
     initializeDataset();
+    selectReductionKernels();
     
     printf("\n================================================\n");
     printf("   DYNAMIC MATH AND DATA PROCESSING ENGINE\n");
     printf("================================================\n");
+    printf("Reduction kernels: %s\n", reductionKernels->name);
     
     while (1) {
         displayMenu();
@@ -190,7 +307,9 @@ void removeElement() {
     
     displayDataset();
     
-    int index = getValidInteger("Enter index to remove (0-%d): ", dataSize - 1);
+    char prompt[64];
+    snprintf(prompt, sizeof(prompt), "Enter index to remove (0-%d): ", dataSize - 1);
+    int index = getValidInteger(prompt);
     
     if (index < 0 || index >= dataSize) {
         printf("Invalid index!\n");
@@ -219,7 +338,9 @@ void modifyElement() {
     
     displayDataset();
     
-    int index = getValidInteger("Enter index to modify (0-%d): ", dataSize - 1);
+    char prompt[64];
+    snprintf(prompt, sizeof(prompt), "Enter index to modify (0-%d): ", dataSize - 1);
+    int index = getValidInteger(prompt);
     
     if (index < 0 || index >= dataSize) {
         printf("Invalid index!\n");
@@ -345,9 +466,22 @@ void displayStatistics() {
     printf("Count:              %d\n", dataSize);
     printf("Sum:                %.2f\n", computeSum(dataset, dataSize));
     printf("Average:            %.2f\n", computeAverage(dataset, dataSize));
-    printf("Minimum:            %.2f\n", findMinimum(dataset, dataSize));
-    printf("Maximum:            %.2f\n", findMaximum(dataset, dataSize));
-    printf("Median:             %.2f\n", computeMedian(dataset, dataSize));
+    
+    // Both extremes from one pass
+    float min, max;
+    activeKernels()->minMax(dataset, dataSize, &min, &max);
+    printf("Minimum:            %.2f\n", min);
+    printf("Maximum:            %.2f\n", max);
+    
+    // Every quantile from one partitioning pass over one copy
+    const double fractions[] = {0.25, 0.5, 0.75, 0.95, 0.99};
+    float quantiles[5];
+    if (computeQuantiles(dataset, dataSize, fractions, quantiles, 5, 0) == 0) {
+        printf("Median:             %.2f\n", quantiles[1]);
+        printf("IQR:                %.2f (Q1 %.2f, Q3 %.2f)\n", quantiles[2] - quantiles[0], quantiles[0], quantiles[2]);
+        printf("95th Percentile:    %.2f\n", quantiles[3]);
+        printf("99th Percentile:    %.2f\n", quantiles[4]);
+    }
     printf("Standard Deviation: %.2f\n", computeStdDev(dataset, dataSize));
     
     printf("=========================================\n");
@@ -355,109 +489,890 @@ void displayStatistics() {
 
 // Math operation: Sum
 float computeSum(float* data, int size) {
-    float sum = 0;
-    for (int i = 0; i < size; i++) {
-        sum += data[i];
-    }
-    return sum;
+    return (float)activeKernels()->sum(data, size);
 }
 
-// Math operation: Average
+// Math operation: Average (divided before rounding the sum to float)
 float computeAverage(float* data, int size) {
     if (size == 0) return 0;
-    return computeSum(data, size) / size;
+    return (float)(activeKernels()->sum(data, size) / size);
 }
 
 // Math operation: Maximum
 float findMaximum(float* data, int size) {
+    float min, max;
     if (size == 0) return 0;
     
-    float max = data[0];
-    for (int i = 1; i < size; i++) {
-        if (data[i] > max) {
-            max = data[i];
-        }
-    }
+    activeKernels()->minMax(data, size, &min, &max);
     return max;
 }
 
 // Math operation: Minimum
 float findMinimum(float* data, int size) {
+    float min, max;
     if (size == 0) return 0;
     
-    float min = data[0];
-    for (int i = 1; i < size; i++) {
-        if (data[i] < min) {
-            min = data[i];
-        }
-    }
+    activeKernels()->minMax(data, size, &min, &max);
     return min;
 }
 
-// Math operation: Median
-float computeMedian(float* data, int size) {
+// Math operation: Range, from one fused min/max pass
+float computeRange(float* data, int size) {
+    float min, max;
     if (size == 0) return 0;
     
-    // Create a copy and sort it
-    float* temp = (float*)malloc(size * sizeof(float));
-    if (temp == NULL) {
+    activeKernels()->minMax(data, size, &min, &max);
+    return max - min;
+}
+
+// Math operation: Median (by selection, without sorting)
+float computeMedian(float* data, int size) {
+    const double half = 0.5;
+    float median = 0;
+    
+    if (size == 0) return 0;
+    if (computeQuantiles(data, size, &half, &median, 1, 0) != 0) {
         printf("Memory allocation failed for median calculation!\n");
         return 0;
     }
+    return median;
+}
+
+// Math operation: 95th percentile
+float computeP95(float* data, int size) {
+    const double fraction = 0.95;
+    float result = 0;
     
-    memcpy(temp, data, size * sizeof(float));
-    sortAscending(temp, size, 0);
+    if (size == 0) return 0;
+    if (computeQuantiles(data, size, &fraction, &result, 1, 0) != 0) {
+        printf("Memory allocation failed for percentile calculation!\n");
+        return 0;
+    }
+    return result;
+}
+
+// Math operation: 99th percentile
+float computeP99(float* data, int size) {
+    const double fraction = 0.99;
+    float result = 0;
     
-    float median;
-    if (size % 2 == 0) {
-        median = (temp[size/2 - 1] + temp[size/2]) / 2.0;
-    } else {
-        median = temp[size/2];
+    if (size == 0) return 0;
+    if (computeQuantiles(data, size, &fraction, &result, 1, 0) != 0) {
+        printf("Memory allocation failed for percentile calculation!\n");
+        return 0;
     }
+    return result;
+}
+
+// Math operation: Interquartile range (Q3 - Q1)
+float computeIQR(float* data, int size) {
+    const double fractions[2] = {0.25, 0.75};
+    float quartiles[2] = {0, 0};
     
-    free(temp);
-    return median;
+    if (size == 0) return 0;
+    if (computeQuantiles(data, size, fractions, quartiles, 2, 0) != 0) {
+        printf("Memory allocation failed for IQR calculation!\n");
+        return 0;
+    }
+    return quartiles[1] - quartiles[0];
 }
 
-// Math operation: Standard Deviation
+// Compute several quantiles (fractions in [0, 1]) in one selection pass,
+// interpolating linearly between the two nearest ranks, so fraction 0.5 of
+// an even-sized dataset is the mean of the middle pair. A quantile that
+// falls on a rank, or between equal values, is that value exactly, so
+// infinities don't turn into NaN. Selection partitions
+// a scratch copy, or data itself if inPlace is set, which leaves data
+// reordered but saves the copy.
+// Returns 0 on success, -1 on bad arguments or allocation failure.
+int computeQuantiles(float* data, int size, const double* fractions, float* results, int count, int inPlace) {
+    int ranks[2 * MAX_QUANTILES];
+    int rankCount = 0;
+    
+    if (size <= 0 || count <= 0 || count > MAX_QUANTILES) return -1;
+    
+    // Both neighbouring ranks of every quantile, sorted and deduplicated
+    for (int q = 0; q < count; q++) {
+        if (!(fractions[q] >= 0.0 && fractions[q] <= 1.0)) return -1;
+        double position = fractions[q] * (size - 1);
+        int lower = (int)position;
+        ranks[rankCount++] = lower;
+        ranks[rankCount++] = lower + 1 < size && position > lower ? lower + 1 : lower;
+    }
+    for (int i = 1; i < rankCount; i++) {
+        int rank = ranks[i];
+        int j = i - 1;
+        while (j >= 0 && ranks[j] > rank) {
+            ranks[j + 1] = ranks[j];
+            j--;
+        }
+        ranks[j + 1] = rank;
+    }
+    int unique = 0;
+    for (int i = 0; i < rankCount; i++) {
+        if (unique == 0 || ranks[unique - 1] != ranks[i]) {
+            ranks[unique++] = ranks[i];
+        }
+    }
+    
+    float* buffer = data;
+    if (!inPlace) {
+        buffer = (float*)malloc((size_t)size * sizeof(float));
+        if (buffer == NULL) return -1;
+        memcpy(buffer, data, (size_t)size * sizeof(float));
+    }
+    
+    int depthLimit = 0;
+    for (int n = size; n > 1; n >>= 1) {
+        depthLimit += 2;
+    }
+    multiSelect(buffer, 0, size - 1, ranks, 0, unique - 1, depthLimit);
+    
+    // Every requested rank now holds the element of that rank
+    for (int q = 0; q < count; q++) {
+        double position = fractions[q] * (size - 1);
+        int lower = (int)position;
+        int upper = lower + 1 < size ? lower + 1 : lower;
+        double weight = position - lower;
+        if (weight == 0 || buffer[upper] == buffer[lower]) {
+            results[q] = buffer[lower];
+        } else {
+            results[q] = (float)(buffer[lower] + weight * ((double)buffer[upper] - buffer[lower]));
+        }
+    }
+    
+    if (!inPlace) {
+        free(buffer);
+    }
+    return 0;
+}
+
+// Introselect for a sorted set of ranks: partition data[low..high] and
+// continue only into the sides that still contain a wanted rank, so the
+// partitions near the top are shared by every quantile. Large ranges get a
+// Floyd-Rivest pivot: the middle wanted rank is first selected within a
+// small sample around it, which lands the pivot very close to that rank, so
+// one pass settles it and the expected cost stays near n comparisons. Past
+// the depth limit the range is sorted outright.
+void multiSelect(float* data, int low, int high, const int* ranks, int firstRank, int lastRank, int depthLimit) {
+    while (firstRank <= lastRank && low < high) {
+        if (high - low + 1 <= INSERTION_SORT_THRESHOLD) {
+            insertionSortFloats(data, low, high);
+            return;
+        }
+        if (depthLimit-- == 0) {
+            introsortFloats(data + low, high - low + 1);
+            return;
+        }
+        
+        int medianOfThree = 1;
+        if (high - low + 1 > FLOYD_RIVEST_THRESHOLD) {
+            int k = ranks[firstRank + (lastRank - firstRank) / 2];
+            double n = high - low + 1;
+            double i = k - low + 1;
+            double z = log(n);
+            double s = 0.5 * exp(2 * z / 3);
+            double sd = 0.5 * sqrt(z * s * (n - s) / n) * (i - n / 2 < 0 ? -1 : 1);
+            int sampleLow = (int)fmax(low, k - i * s / n + sd);
+            int sampleHigh = (int)fmin(high, k + (n - i) * s / n + sd);
+            int sampleRank[1] = {k};
+            multiSelect(data, sampleLow, sampleHigh, sampleRank, 0, 0, depthLimit);
+            swapFloats(data, low, k);
+            medianOfThree = 0;
+        }
+        
+        int pivot = partitionFloats(data, low, high, medianOfThree);
+        
+        // Ranks below the pivot's final slot go left, the rest right
+        int split = firstRank;
+        while (split <= lastRank && ranks[split] < pivot) {
+            split++;
+        }
+        int right = split <= lastRank && ranks[split] == pivot ? split + 1 : split;
+        
+        if (split - firstRank < lastRank - right + 1) {
+            multiSelect(data, low, pivot - 1, ranks, firstRank, split - 1, depthLimit);
+            low = pivot + 1;
+            firstRank = right;
+        } else {
+            multiSelect(data, pivot + 1, high, ranks, right, lastRank, depthLimit);
+            high = pivot - 1;
+            lastRank = split - 1;
+        }
+    }
+}
+
+// Math operation: Standard Deviation (population), two passes in double
 float computeStdDev(float* data, int size) {
     if (size <= 1) return 0;
     
-    float mean = computeAverage(data, size);
-    float sumSquaredDiff = 0;
+    const ReductionKernels* kernels = activeKernels();
+    double mean = kernels->sum(data, size) / size;
+    return (float)sqrt(kernels->sumSquaredDiff(data, size, mean) / size);
+}
+
+// Pick the widest reduction kernels this CPU runs, once
+void selectReductionKernels() {
+#if REDUCTION_X86
+    __builtin_cpu_init();
+#endif
+    for (int i = 0; i < reductionKernelCount; i++) {
+        if (reductionKernelTable[i].supported()) {
+            reductionKernels = &reductionKernelTable[i];
+            return;
+        }
+    }
+}
+
+// Kernels for the current CPU, selected on first use
+const ReductionKernels* activeKernels() {
+    if (reductionKernels == NULL) {
+        selectReductionKernels();
+    }
+    return reductionKernels;
+}
+
+// The scalar kernels run everywhere
+int cpuHasScalar() {
+    return 1;
+}
+
+// Scalar sum: four double accumulators break the add dependency chain
+double sumScalar(const float* data, int size) {
+    double acc[4] = {0, 0, 0, 0};
+    int i = 0;
+    
+    for (; i + 4 <= size; i += 4) {
+        acc[0] += data[i];
+        acc[1] += data[i + 1];
+        acc[2] += data[i + 2];
+        acc[3] += data[i + 3];
+    }
+    for (; i < size; i++) {
+        acc[0] += data[i];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+// Scalar sum of squared deviations from mean
+double sumSquaredDiffScalar(const float* data, int size, double mean) {
+    double acc[4] = {0, 0, 0, 0};
+    int i = 0;
+    
+    for (; i + 4 <= size; i += 4) {
+        for (int lane = 0; lane < 4; lane++) {
+            double diff = data[i + lane] - mean;
+            acc[lane] += diff * diff;
+        }
+    }
+    for (; i < size; i++) {
+        double diff = data[i] - mean;
+        acc[0] += diff * diff;
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+// Scalar minimum and maximum in one pass. Comparisons match the vector
+// kernels: a NaN element is skipped, unless data[0] is NaN.
+void minMaxScalar(const float* data, int size, float* min, float* max) {
+    float low = data[0];
+    float high = data[0];
     
-    for (int i = 0; i < size; i++) {
-        float diff = data[i] - mean;
-        sumSquaredDiff += diff * diff;
+    for (int i = 1; i < size; i++) {
+        low = data[i] < low ? data[i] : low;
+        high = data[i] > high ? data[i] : high;
+    }
+    *min = low;
+    *max = high;
+}
+
+#if REDUCTION_X86
+// SSE2 is part of x86-64, but is checked like the others for 32-bit builds
+int cpuHasSSE2() {
+    return __builtin_cpu_supports("sse2");
+}
+
+int cpuHasAVX2() {
+    return __builtin_cpu_supports("avx2");
+}
+
+int cpuHasAVX512() {
+    return __builtin_cpu_supports("avx512f");
+}
+
+// SSE2 sum: 8 floats per step, widened to double into four accumulators
+__attribute__((target("sse2")))
+double sumSSE2(const float* data, int size) {
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    __m128d acc2 = _mm_setzero_pd(), acc3 = _mm_setzero_pd();
+    int i = 0;
+    
+    for (; i + 8 <= size; i += 8) {
+        __m128 a = _mm_loadu_ps(data + i);
+        __m128 b = _mm_loadu_ps(data + i + 4);
+        acc0 = _mm_add_pd(acc0, _mm_cvtps_pd(a));
+        acc1 = _mm_add_pd(acc1, _mm_cvtps_pd(_mm_movehl_ps(a, a)));
+        acc2 = _mm_add_pd(acc2, _mm_cvtps_pd(b));
+        acc3 = _mm_add_pd(acc3, _mm_cvtps_pd(_mm_movehl_ps(b, b)));
+    }
+    
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(_mm_add_pd(acc0, acc1), _mm_add_pd(acc2, acc3)));
+    return lanes[0] + lanes[1] + sumScalar(data + i, size - i);
+}
+
+// SSE2 sum of squared deviations
+__attribute__((target("sse2")))
+double sumSquaredDiffSSE2(const float* data, int size, double mean) {
+    __m128d center = _mm_set1_pd(mean);
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    __m128d acc2 = _mm_setzero_pd(), acc3 = _mm_setzero_pd();
+    int i = 0;
+    
+    for (; i + 8 <= size; i += 8) {
+        __m128 a = _mm_loadu_ps(data + i);
+        __m128 b = _mm_loadu_ps(data + i + 4);
+        __m128d d0 = _mm_sub_pd(_mm_cvtps_pd(a), center);
+        __m128d d1 = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(a, a)), center);
+        __m128d d2 = _mm_sub_pd(_mm_cvtps_pd(b), center);
+        __m128d d3 = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(b, b)), center);
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+        acc2 = _mm_add_pd(acc2, _mm_mul_pd(d2, d2));
+        acc3 = _mm_add_pd(acc3, _mm_mul_pd(d3, d3));
+    }
+    
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(_mm_add_pd(acc0, acc1), _mm_add_pd(acc2, acc3)));
+    return lanes[0] + lanes[1] + sumSquaredDiffScalar(data + i, size - i, mean);
+}
+
+// SSE2 minimum and maximum, two accumulators of each
+__attribute__((target("sse2")))
+void minMaxSSE2(const float* data, int size, float* min, float* max) {
+    __m128 low0 = _mm_set1_ps(data[0]), low1 = low0;
+    __m128 high0 = low0, high1 = low0;
+    int i = 0;
+    
+    for (; i + 8 <= size; i += 8) {
+        __m128 a = _mm_loadu_ps(data + i);
+        __m128 b = _mm_loadu_ps(data + i + 4);
+        low0 = _mm_min_ps(a, low0);
+        low1 = _mm_min_ps(b, low1);
+        high0 = _mm_max_ps(a, high0);
+        high1 = _mm_max_ps(b, high1);
+    }
+    
+    float lows[8], highs[8];
+    _mm_storeu_ps(lows, low0);
+    _mm_storeu_ps(lows + 4, low1);
+    _mm_storeu_ps(highs, high0);
+    _mm_storeu_ps(highs + 4, high1);
+    minMaxLanes(lows, highs, 8, data + i, size - i, min, max);
+}
+
+// AVX2 sum: 16 floats per step, widened to double into four accumulators
+__attribute__((target("avx2")))
+double sumAVX2(const float* data, int size) {
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    __m256d acc2 = _mm256_setzero_pd(), acc3 = _mm256_setzero_pd();
+    int i = 0;
+    
+    for (; i + 16 <= size; i += 16) {
+        __m256 a = _mm256_loadu_ps(data + i);
+        __m256 b = _mm256_loadu_ps(data + i + 8);
+        acc0 = _mm256_add_pd(acc0, _mm256_cvtps_pd(_mm256_castps256_ps128(a)));
+        acc1 = _mm256_add_pd(acc1, _mm256_cvtps_pd(_mm256_extractf128_ps(a, 1)));
+        acc2 = _mm256_add_pd(acc2, _mm256_cvtps_pd(_mm256_castps256_ps128(b)));
+        acc3 = _mm256_add_pd(acc3, _mm256_cvtps_pd(_mm256_extractf128_ps(b, 1)));
+    }
+    
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(_mm256_add_pd(acc0, acc1), _mm256_add_pd(acc2, acc3)));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + sumScalar(data + i, size - i);
+}
+
+// AVX2 sum of squared deviations
+__attribute__((target("avx2")))
+double sumSquaredDiffAVX2(const float* data, int size, double mean) {
+    __m256d center = _mm256_set1_pd(mean);
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    __m256d acc2 = _mm256_setzero_pd(), acc3 = _mm256_setzero_pd();
+    int i = 0;
+    
+    for (; i + 16 <= size; i += 16) {
+        __m256 a = _mm256_loadu_ps(data + i);
+        __m256 b = _mm256_loadu_ps(data + i + 8);
+        __m256d d0 = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(a)), center);
+        __m256d d1 = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(a, 1)), center);
+        __m256d d2 = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(b)), center);
+        __m256d d3 = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(b, 1)), center);
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(d0, d0));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d1, d1));
+        acc2 = _mm256_add_pd(acc2, _mm256_mul_pd(d2, d2));
+        acc3 = _mm256_add_pd(acc3, _mm256_mul_pd(d3, d3));
+    }
+    
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(_mm256_add_pd(acc0, acc1), _mm256_add_pd(acc2, acc3)));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + sumSquaredDiffScalar(data + i, size - i, mean);
+}
+
+// AVX2 minimum and maximum, two accumulators of each
+__attribute__((target("avx2")))
+void minMaxAVX2(const float* data, int size, float* min, float* max) {
+    __m256 low0 = _mm256_set1_ps(data[0]), low1 = low0;
+    __m256 high0 = low0, high1 = low0;
+    int i = 0;
+    
+    for (; i + 16 <= size; i += 16) {
+        __m256 a = _mm256_loadu_ps(data + i);
+        __m256 b = _mm256_loadu_ps(data + i + 8);
+        low0 = _mm256_min_ps(a, low0);
+        low1 = _mm256_min_ps(b, low1);
+        high0 = _mm256_max_ps(a, high0);
+        high1 = _mm256_max_ps(b, high1);
+    }
+    
+    float lows[16], highs[16];
+    _mm256_storeu_ps(lows, low0);
+    _mm256_storeu_ps(lows + 8, low1);
+    _mm256_storeu_ps(highs, high0);
+    _mm256_storeu_ps(highs + 8, high1);
+    minMaxLanes(lows, highs, 16, data + i, size - i, min, max);
+}
+
+// AVX-512 sum: 32 floats per step, widened to double into four accumulators
+__attribute__((target("avx512f")))
+double sumAVX512(const float* data, int size) {
+    __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+    __m512d acc2 = _mm512_setzero_pd(), acc3 = _mm512_setzero_pd();
+    int i = 0;
+    
+    for (; i + 32 <= size; i += 32) {
+        __m512 a = _mm512_loadu_ps(data + i);
+        __m512 b = _mm512_loadu_ps(data + i + 16);
+        acc0 = _mm512_add_pd(acc0, _mm512_cvtps_pd(_mm512_castps512_ps256(a)));
+        acc1 = _mm512_add_pd(acc1, _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a), 1))));
+        acc2 = _mm512_add_pd(acc2, _mm512_cvtps_pd(_mm512_castps512_ps256(b)));
+        acc3 = _mm512_add_pd(acc3, _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(b), 1))));
+    }
+    
+    double total = _mm512_reduce_add_pd(_mm512_add_pd(_mm512_add_pd(acc0, acc1), _mm512_add_pd(acc2, acc3)));
+    return total + sumScalar(data + i, size - i);
+}
+
+// AVX-512 sum of squared deviations
+__attribute__((target("avx512f")))
+double sumSquaredDiffAVX512(const float* data, int size, double mean) {
+    __m512d center = _mm512_set1_pd(mean);
+    __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+    int i = 0;
+    
+    for (; i + 16 <= size; i += 16) {
+        __m512 a = _mm512_loadu_ps(data + i);
+        __m512d d0 = _mm512_sub_pd(_mm512_cvtps_pd(_mm512_castps512_ps256(a)), center);
+        __m512d d1 = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a), 1))), center);
+        acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+        acc1 = _mm512_fmadd_pd(d1, d1, acc1);
+    }
+    
+    double total = _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+    return total + sumSquaredDiffScalar(data + i, size - i, mean);
+}
+
+// AVX-512 minimum and maximum, two accumulators of each
+__attribute__((target("avx512f")))
+void minMaxAVX512(const float* data, int size, float* min, float* max) {
+    __m512 low0 = _mm512_set1_ps(data[0]), low1 = low0;
+    __m512 high0 = low0, high1 = low0;
+    int i = 0;
+    
+    for (; i + 32 <= size; i += 32) {
+        __m512 a = _mm512_loadu_ps(data + i);
+        __m512 b = _mm512_loadu_ps(data + i + 16);
+        low0 = _mm512_min_ps(a, low0);
+        low1 = _mm512_min_ps(b, low1);
+        high0 = _mm512_max_ps(a, high0);
+        high1 = _mm512_max_ps(b, high1);
     }
     
-    return sqrt(sumSquaredDiff / size);
+    float lows[32], highs[32];
+    _mm512_storeu_ps(lows, low0);
+    _mm512_storeu_ps(lows + 16, low1);
+    _mm512_storeu_ps(highs, high0);
+    _mm512_storeu_ps(highs + 16, high1);
+    minMaxLanes(lows, highs, 32, data + i, size - i, min, max);
+}
+#endif
+
+// Finish a vector min/max: fold the lanes, then the elements the vector
+// loop didn't reach, all with the same comparisons as the lanes
+void minMaxLanes(const float* lows, const float* highs, int lanes, const float* rest, int restSize, float* min, float* max) {
+    float low = lows[0];
+    float high = highs[0];
+    
+    for (int i = 1; i < lanes; i++) {
+        low = lows[i] < low ? lows[i] : low;
+        high = highs[i] > high ? highs[i] : high;
+    }
+    for (int i = 0; i < restSize; i++) {
+        low = rest[i] < low ? rest[i] : low;
+        high = rest[i] > high ? rest[i] : high;
+    }
+    *min = low;
+    *max = high;
 }
 
-// Sort ascending (Bubble Sort)
+// Sort ascending: introsort for small arrays, radix sort for large ones and
+// a parallel radix sort plus merge for multi-million element datasets
 void sortAscending(float* data, int size, int dummy) {
-    for (int i = 0; i < size - 1; i++) {
-        for (int j = 0; j < size - i - 1; j++) {
-            if (data[j] > data[j + 1]) {
-                float temp = data[j];
-                data[j] = data[j + 1];
-                data[j + 1] = temp;
-            }
-        }
+    (void)dummy;
+    if (size < 2) return;
+    
+    if (size >= PARALLEL_SORT_THRESHOLD && sortParallel(data, size) == 0) {
+        return;
+    }
+    if (size >= RADIX_SORT_THRESHOLD && radixSortFloats(data, size) == 0) {
+        return;
     }
+    // Small arrays, or no memory for a scratch buffer: sort in place
+    introsortFloats(data, size);
 }
 
-// Sort descending
+// Sort descending: ascending, then reversed in place
 void sortDescending(float* data, int size, int dummy) {
-    for (int i = 0; i < size - 1; i++) {
-        for (int j = 0; j < size - i - 1; j++) {
-            if (data[j] < data[j + 1]) {
-                float temp = data[j];
-                data[j] = data[j + 1];
-                data[j + 1] = temp;
+    sortAscending(data, size, dummy);
+    for (int i = 0, j = size - 1; i < j; i++, j--) {
+        float temp = data[i];
+        data[i] = data[j];
+        data[j] = temp;
+    }
+}
+
+// Map a float's bits to an unsigned key with the same order: negative
+// values have every bit flipped, positive ones just the sign bit. This is a
+// total order (-NaN < -inf < ... < -0 < +0 < ... < +inf < +NaN), which
+// every sort path shares, so they agree on where NaNs and zeros go.
+uint32_t floatKey(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits ^ ((bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u);
+}
+
+// Inverse of floatKey
+float keyToFloat(uint32_t key) {
+    uint32_t bits = key ^ ((key & 0x80000000u) ? 0x80000000u : 0xFFFFFFFFu);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Introsort: median-of-three quicksort that switches to heapsort when the
+// recursion gets too deep, and to insertion sort for short ranges
+void introsortFloats(float* data, int size) {
+    int depthLimit = 0;
+    for (int n = size; n > 1; n >>= 1) {
+        depthLimit += 2;
+    }
+    introsortRange(data, 0, size - 1, depthLimit);
+    insertionSortFloats(data, 0, size - 1);
+}
+
+// Partition data[low..high] until ranges are short; the final insertion
+// sort pass finishes them
+void introsortRange(float* data, int low, int high, int depthLimit) {
+    while (high - low + 1 > INSERTION_SORT_THRESHOLD) {
+        if (depthLimit-- == 0) {
+            heapSortFloats(data + low, high - low + 1);
+            return;
+        }
+        
+        int j = partitionFloats(data, low, high, 1);
+        
+        // Recurse into the smaller side, loop on the larger
+        if (j - low < high - j) {
+            introsortRange(data, low, j - 1, depthLimit);
+            low = j + 1;
+        } else {
+            introsortRange(data, j + 1, high, depthLimit);
+            high = j - 1;
+        }
+    }
+}
+
+// Partition data[low..high] around a pivot and return its final index:
+// everything before it is no greater and everything after no smaller. The
+// pivot is the median of three, or whatever the caller put in data[low].
+int partitionFloats(float* data, int low, int high, int medianOfThree) {
+    if (medianOfThree) {
+        int mid = low + (high - low) / 2;
+        if (floatKey(data[mid]) < floatKey(data[low])) swapFloats(data, mid, low);
+        if (floatKey(data[high]) < floatKey(data[low])) swapFloats(data, high, low);
+        if (floatKey(data[high]) < floatKey(data[mid])) swapFloats(data, high, mid);
+        swapFloats(data, low, mid);
+    }
+    uint32_t pivot = floatKey(data[low]);
+    
+    // Hoare partition. Scans stop on keys equal to the pivot, so runs of
+    // duplicates still split evenly; the pivot stops the downward scan.
+    int i = low;
+    int j = high + 1;
+    while (1) {
+        do {
+            i++;
+        } while (i <= high && floatKey(data[i]) < pivot);
+        do {
+            j--;
+        } while (pivot < floatKey(data[j]));
+        if (i >= j) break;
+        swapFloats(data, i, j);
+    }
+    swapFloats(data, low, j);
+    return j;
+}
+
+// Insertion sort of data[low..high]
+void insertionSortFloats(float* data, int low, int high) {
+    for (int i = low + 1; i <= high; i++) {
+        float value = data[i];
+        uint32_t key = floatKey(value);
+        int j = i - 1;
+        while (j >= low && floatKey(data[j]) > key) {
+            data[j + 1] = data[j];
+            j--;
+        }
+        data[j + 1] = value;
+    }
+}
+
+// Heapsort, the introsort fallback for adversarial inputs
+void heapSortFloats(float* data, int size) {
+    for (int start = size / 2 - 1; start >= 0; start--) {
+        siftDownFloats(data, start, size);
+    }
+    for (int end = size - 1; end > 0; end--) {
+        swapFloats(data, 0, end);
+        siftDownFloats(data, 0, end);
+    }
+}
+
+// Restore the max-heap property below root in data[0..size-1]
+void siftDownFloats(float* data, int root, int size) {
+    while (2 * root + 1 < size) {
+        int child = 2 * root + 1;
+        if (child + 1 < size && floatKey(data[child]) < floatKey(data[child + 1])) {
+            child++;
+        }
+        if (floatKey(data[root]) >= floatKey(data[child])) {
+            return;
+        }
+        swapFloats(data, root, child);
+        root = child;
+    }
+}
+
+// Swap two elements
+void swapFloats(float* data, int a, int b) {
+    float temp = data[a];
+    data[a] = data[b];
+    data[b] = temp;
+}
+
+// LSD radix sort on floatKey: three passes of 11 bits. All three
+// histograms are counted in one read of the data, and a pass whose digit is
+// the same for every element is skipped.
+// Returns 0 on success, -1 if the scratch buffer can't be allocated.
+int radixSortFloats(float* data, int size) {
+    uint32_t* keys = (uint32_t*)malloc((size_t)size * sizeof(uint32_t));
+    uint32_t* scratch = (uint32_t*)malloc((size_t)size * sizeof(uint32_t));
+    size_t* counts = (size_t*)calloc(RADIX_PASSES * RADIX_BUCKETS, sizeof(size_t));
+    if (keys == NULL || scratch == NULL || counts == NULL) {
+        free(keys);
+        free(scratch);
+        free(counts);
+        return -1;
+    }
+    
+    for (int i = 0; i < size; i++) {
+        uint32_t key = floatKey(data[i]);
+        keys[i] = key;
+        for (int pass = 0; pass < RADIX_PASSES; pass++) {
+            counts[pass * RADIX_BUCKETS + ((key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1))]++;
+        }
+    }
+    
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+        size_t* count = counts + pass * RADIX_BUCKETS;
+        int shift = pass * RADIX_BITS;
+        if (count[(keys[0] >> shift) & (RADIX_BUCKETS - 1)] == (size_t)size) {
+            continue;
+        }
+        
+        // Counts become each bucket's first output slot
+        size_t offset = 0;
+        for (int b = 0; b < RADIX_BUCKETS; b++) {
+            size_t bucket = count[b];
+            count[b] = offset;
+            offset += bucket;
+        }
+        for (int i = 0; i < size; i++) {
+            scratch[count[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++] = keys[i];
+        }
+        
+        uint32_t* swap = keys;
+        keys = scratch;
+        scratch = swap;
+    }
+    
+    for (int i = 0; i < size; i++) {
+        data[i] = keyToFloat(keys[i]);
+    }
+    
+    free(keys);
+    free(scratch);
+    free(counts);
+    return 0;
+}
+
+// Parallel sort: each thread radix-sorts one slice, then the sorted runs
+// are merged pairwise, each merge split across threads along its merge
+// path so every thread writes an equal share of the output.
+// Returns 0 on success, -1 to let the caller sort on one thread (one core,
+// or no memory for the merge buffer).
+int sortParallel(float* data, int size) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int threadCount = 1;
+    while (threadCount * 2 <= cores && threadCount * 2 <= MAX_SORT_THREADS) {
+        threadCount *= 2;
+    }
+    if (threadCount < 2) {
+        return -1;
+    }
+    
+    float* scratch = (float*)malloc((size_t)size * sizeof(float));
+    if (scratch == NULL) {
+        return -1;
+    }
+    
+    pthread_t threads[MAX_SORT_THREADS];
+    SortTask tasks[MAX_SORT_THREADS];
+    int runStart[MAX_SORT_THREADS + 1];
+    
+    for (int t = 0; t <= threadCount; t++) {
+        runStart[t] = (int)((long long)size * t / threadCount);
+    }
+    
+    // Sort each slice in place
+    for (int t = 0; t < threadCount; t++) {
+        memset(&tasks[t], 0, sizeof(SortTask));
+        tasks[t].a = data + runStart[t];
+        tasks[t].lengthA = runStart[t + 1] - runStart[t];
+    }
+    runSortTasks(threads, tasks, threadCount, sortSliceTask);
+    
+    // Merge pairs of runs until one is left, alternating buffers
+    float* source = data;
+    float* target = scratch;
+    for (int runs = threadCount; runs > 1; runs /= 2) {
+        int perPair = threadCount / (runs / 2);
+        for (int pair = 0; pair < runs / 2; pair++) {
+            int start = runStart[pair * 2];
+            int middle = runStart[pair * 2 + 1];
+            int end = runStart[pair * 2 + 2];
+            for (int part = 0; part < perPair; part++) {
+                SortTask* task = &tasks[pair * perPair + part];
+                task->a = source + start;
+                task->lengthA = middle - start;
+                task->b = source + middle;
+                task->lengthB = end - middle;
+                task->out = target + start;
+                task->outBegin = (int)((long long)(end - start) * part / perPair);
+                task->outEnd = (int)((long long)(end - start) * (part + 1) / perPair);
             }
         }
+        runSortTasks(threads, tasks, threadCount, mergeTask);
+        
+        // The merged runs start where every other old run did
+        for (int r = 0; r <= runs / 2; r++) {
+            runStart[r] = runStart[r * 2];
+        }
+        float* swap = source;
+        source = target;
+        target = swap;
+    }
+    
+    if (source != data) {
+        memcpy(data, source, (size_t)size * sizeof(float));
+    }
+    free(scratch);
+    return 0;
+}
+
+// Run one task per thread and wait for all of them. A task whose thread
+// can't be started runs on the calling thread instead.
+void runSortTasks(pthread_t* threads, SortTask* tasks, int count, void* (*work)(void*)) {
+    int started[MAX_SORT_THREADS];
+    
+    for (int t = 1; t < count; t++) {
+        started[t] = pthread_create(&threads[t], NULL, work, &tasks[t]) == 0;
+        if (!started[t]) {
+            work(&tasks[t]);
+        }
+    }
+    work(&tasks[0]);
+    
+    for (int t = 1; t < count; t++) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        }
+    }
+}
+
+// Thread body: sort one slice
+void* sortSliceTask(void* arg) {
+    SortTask* task = (SortTask*)arg;
+    if (task->lengthA >= RADIX_SORT_THRESHOLD && radixSortFloats(task->a, task->lengthA) == 0) {
+        return NULL;
+    }
+    if (task->lengthA > 1) {
+        introsortFloats(task->a, task->lengthA);
+    }
+    return NULL;
+}
+
+// Thread body: write out[outBegin..outEnd) of the merge of a and b. The
+// split points are found by binary search along the merge path, taking from
+// a on ties so the merge is stable.
+void* mergeTask(void* arg) {
+    SortTask* task = (SortTask*)arg;
+    int i = mergePathSplit(task->a, task->lengthA, task->b, task->lengthB, task->outBegin);
+    int j = task->outBegin - i;
+    
+    for (int k = task->outBegin; k < task->outEnd; k++) {
+        if (j >= task->lengthB || (i < task->lengthA && floatKey(task->a[i]) <= floatKey(task->b[j]))) {
+            task->out[k] = task->a[i++];
+        } else {
+            task->out[k] = task->b[j++];
+        }
+    }
+    return NULL;
+}
+
+// How many of the first k merged elements come from a
+int mergePathSplit(const float* a, int lengthA, const float* b, int lengthB, int k) {
+    int low = k > lengthB ? k - lengthB : 0;
+    int high = k < lengthA ? k : lengthA;
+    
+    while (low < high) {
+        int i = low + (high - low) / 2;
+        if (floatKey(a[i]) <= floatKey(b[k - i - 1])) {
+            low = i + 1;
+        } else {
+            high = i;
+        }
     }
+    return low;
 }
 
 // Search for a value (Linear Search)
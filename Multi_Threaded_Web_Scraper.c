@@ -1,46 +1,753 @@
 /*
  * Multi-threaded Web Scraper
- * Description: Parallel web scraping using POSIX threads
+ * Description: Parallel web scraping using POSIX threads or a curl_multi event loop
  * Author: Student Submission
  * Date: November 2025
  * 
  * Compilation: gcc -pthread web_scraper.c -o web_scraper -lcurl
- * Usage: ./web_scraper
+ *              (add -DHAVE_ZSTD ... -lzstd for --compress zstd,
+ *               -DHAVE_OPENSSL ... -lcrypto for --cas-hash sha256)
+ * Usage: ./web_scraper [-e threads|multi] [-w workers] [-c transfers]
+ *                      [-s stream|memory] [--direct] [--http2] [--max-streams N]
+ *        ./web_scraper --seed urls.txt [-o dir] [--concurrency N]
+ *                      [--timeout secs] [--connect-timeout secs]
+ *                      [--timings timings.jsonl]
+ *        politeness: [--per-host N] [--host-rate R] [--host-burst B] [--robots]
+ *        retries:    [--retries N]
+ *        cache:      [--no-cache]
+ *        storage:    [--compress zstd|none] [--zstd-level N] [--zstd-dict FILE]
+ *                    [--archive] [--segment-size MB] [--cas] [--cas-hash xxh64|sha256]
+ *        crawl:      [--depth N] [--same-host] [--max-pages N] [--checkpoint]
+ *        extract:    [--extract records.jsonl] [--extract-threads N]
+ *        dns:        [--dns-threads N] [--dns-ttl SECS]
+ *        memory:     [--memory-budget MB] [--max-body MB]
+ *        output:     [-v] [--no-progress] [--metrics FILE]
+ *        ./web_scraper --bench [-e threads|multi] [-s stream|memory] [--bench-levels 1,4,16]
+ *                      [--bench-requests N] [--bench-latency MS] [--bench-body N[-MAX]]
+ *                      [--bench-errors F] [--bench-chunked]
+ *        ./web_scraper --archive-get URL [-o dir] [--zstd-dict FILE]
+ *        (batch mode: runs to completion and prints JSON stats)
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdarg.h>
 #include <pthread.h>
 #include <curl/curl.h>
 #include <unistd.h>
 #include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_OPENSSL
+#include <openssl/evp.h>
+#endif
 
-#define MAX_URLS 20
-#define MAX_URL_LENGTH 512
+#define MAX_URL_LENGTH 2048
 #define MAX_FILENAME 100
+#define MAX_PATH_LENGTH 512
 #define OUTPUT_DIR "scraped_data"
+#define MAX_WORKERS 256
+#define MAX_EVENTS 256
+#define DEFAULT_MAX_INFLIGHT 64
+#define DEFAULT_MAX_STREAMS 100
+#define MAX_LOOP_WAIT_MS 100
 
-// Structure to hold thread data
+// Fetch engines
+#define ENGINE_THREADS 0
+#define ENGINE_MULTI 1
+
+// How response bodies reach disk
+#define STORE_STREAM 0
+#define STORE_MEMORY 1
+
+// On-disk page compression
+#define COMPRESS_NONE 0
+#define COMPRESS_ZSTD 1
+#define DEFAULT_ZSTD_LEVEL 3
+
+// Content-addressed storage: bodies named by their hash under CAS_DIR,
+// with URL records in CAS_MANIFEST_FILE (both in the output directory)
+#define CAS_DIR "objects"
+#define CAS_MANIFEST_FILE "objects.tsv"
+#define CAS_HASH_XXH64 0
+#define CAS_HASH_SHA256 1
+#ifdef HAVE_OPENSSL
+#define DEFAULT_CAS_HASH CAS_HASH_SHA256
+#else
+#define DEFAULT_CAS_HASH CAS_HASH_XXH64
+#endif
+#define CAS_NAME_LENGTH 65
+
+// XXH64 primes
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+// Packed archive output, kept in the output directory
+#define ARCHIVE_INDEX_FILE "archive.cdx"
+#define ARCHIVE_PENDING_FILE "archive.cdx.pending"
+#define DEFAULT_SEGMENT_MB 1024
+#define MAX_CONTENT_TYPE_LENGTH 256
+
+// Recursive crawl: link scanner states and the sharded URL-seen set
+#define LINK_SCAN_OFF 0
+#define LINK_SCAN_PENDING 1
+#define LINK_SCAN_TEXT 2
+#define LINK_SCAN_TAG 3
+#define LINK_SCAN_NAME 4
+#define LINK_SCAN_EQUALS 5
+#define LINK_SCAN_VALUE 6
+#define LINK_SCAN_SKIP 7
+#define SEEN_SHARD_BITS 6
+#define SEEN_SHARDS (1 << SEEN_SHARD_BITS)
+#define INITIAL_SEEN_CAPACITY 256
+
+// Resolver pool and the in-process DNS cache it fills. getaddrinfo doesn't
+// report record TTLs, so entries live for a fixed, configurable time.
+#define DEFAULT_DNS_THREADS 4
+#define MAX_DNS_THREADS 64
+#define DEFAULT_DNS_TTL 60
+#define DNS_NEGATIVE_TTL 5
+#define MAX_DNS_ADDRESSES 8
+#define DNS_ADDRESS_LENGTH (MAX_DNS_ADDRESSES * (INET6_ADDRSTRLEN + 3))
+#define MAX_HOST_NAME 256
+#define INITIAL_DNS_TABLE 1024
+#define DNS_EMPTY 0
+#define DNS_PENDING 1
+#define DNS_READY 2
+#define DNS_FAILED 3
+
+// Buffer sizes
+#define INITIAL_BUFFER_SIZE (16 * 1024)
+#define STAGING_BUFFER_SIZE (256 * 1024)
+#define DIRECT_IO_ALIGN 4096
+#define MAX_POOLED_BUFFERS 64
+#define MAX_POOLED_CAPACITY (1024 * 1024)
+
+// In-flight body memory: the default budget, and how a transfer that wants
+// more than is left behaves (give up, block, or take it regardless)
+#define DEFAULT_MEMORY_BUDGET_MB 256
+#define BUDGET_TRY 0
+#define BUDGET_WAIT 1
+#define BUDGET_FORCE 2
+
+// Job store layout: jobs live in fixed blocks that never move, so workers can
+// hold pointers while other threads append. 65536 blocks of 4096 jobs.
+#define JOB_BLOCK_SHIFT 12
+#define JOB_BLOCK_SIZE (1 << JOB_BLOCK_SHIFT)
+#define MAX_JOB_BLOCKS 65536
+#define ARENA_BLOCK_SIZE (1024 * 1024)
+
+// Seed files are split across up to MAX_SEED_THREADS scanners, each taking
+// at least SEED_CHUNK_MIN bytes
+#define MAX_SEED_THREADS 16
+#define SEED_CHUNK_MIN (4 * 1024 * 1024)
+
+// Request timing phases recorded per job. Each is the time spent in that
+// phase alone; total is the whole request.
+#define PHASE_DNS 0
+#define PHASE_CONNECT 1
+#define PHASE_TLS 2
+#define PHASE_SERVER 3
+#define PHASE_TRANSFER 4
+#define PHASE_TOTAL 5
+#define PHASE_COUNT 6
+
+// Per-host politeness defaults (0 disables a limit)
+#define DEFAULT_MAX_PER_HOST 6
+#define DEFAULT_HOST_BURST 1
+#define MAX_ROBOTS_SIZE (512 * 1024)
+#define INITIAL_HOST_TABLE 1024
+
+// Retry classes for failed transfers
+#define RETRY_NONE 0
+#define RETRY_TIMEOUT 1
+#define RETRY_SERVER 2
+#define RETRY_CONNECTION 3
+#define RETRY_CLASSES 4
+
+// Retry defaults
+#define DEFAULT_MAX_RETRIES 3
+#define MAX_RETRY_DELAY_MS 60000
+#define INITIAL_RETRY_CAPACITY 64
+
+// Conditional re-fetch cache, kept in the output directory
+#define CACHE_INDEX_FILE "cache_index.tsv"
+#define MAX_VALIDATOR_LENGTH 256
+#define INITIAL_CACHE_CAPACITY 1024
+
+// FNV-1a 64-bit parameters (URL keys and content hashes)
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+// Checkpoint journal (crash-safe resume)
+#define CHECKPOINT_JOURNAL_FILE "crawl.journal"
+#define CHECKPOINT_SNAPSHOT_FILE "crawl.snapshot"
+#define CHECKPOINT_COMMIT_MS 200
+#define CHECKPOINT_FLUSH_BYTES (256 * 1024)
+#define CHECKPOINT_SNAPSHOT_RECORDS 100000
+
+// Post-fetch extraction stage: pages waiting to be parsed, and the pool
+// that parses them
+#define EXTRACT_QUEUE_SIZE 64
+#define DEFAULT_EXTRACT_THREADS 2
+#define MAX_EXTRACT_THREADS 64
+
+// Live progress reporting
+#define PROGRESS_INTERVAL_MS 500
+#define CACHE_LINE_SIZE 64
+
+// Batch mode exit status when some pages could not be fetched
+#define BATCH_EXIT_FAILED 2
+
+// Benchmark mode: mock server and default workload
+#define MAX_BENCH_LEVELS 32
+#define DEFAULT_BENCH_LEVELS "1,4,16,64"
+#define DEFAULT_BENCH_REQUESTS 2000
+#define DEFAULT_BENCH_BODY 16384
+#define BENCH_MAX_FDS 65536
+#define BENCH_REQUEST_LIMIT 8192
+#define BENCH_CHUNK_SIZE 16384
+#define BENCH_DIR_TEMPLATE "/tmp/web_scraper_bench.XXXXXX"
+
+// Log2 histogram buckets: bucket i counts values in [2^i, 2^(i+1)) microseconds
+#define HISTOGRAM_BUCKETS 32
+
+// Structure to hold per-job data (one entry per URL, not per thread).
+// The URL lives in the string arena; the output path is derived from the ID.
 typedef struct {
+    const char* url;
+    uint32_t urlLength;
     int threadID;
-    char url[MAX_URL_LENGTH];
-    char outputFile[MAX_FILENAME];
+    int workerID;
     int success;
     size_t dataSize;
-    time_t startTime;
-    time_t endTime;
+    uint64_t startTime;
+    uint64_t endTime;
+    uint32_t phaseMicros[PHASE_COUNT];
+    int hostIndex;
+    int nextInHost;
+    int attempts;
+    int notModified;
+    int depth;
+    int duplicate;
+    int resumed;
+    int checkpointed;
+    int multiplexed;
 } ThreadData;
 
+// Block of interned URL strings
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} ArenaBlock;
+
 // Structure for curl write callback
 typedef struct {
     char* data;
     size_t size;
+    size_t capacity;
 } MemoryStruct;
 
+// URL inside the mapped seed file
+typedef struct {
+    const char* url;
+    uint32_t length;
+} SeedView;
+
+// One seed scanner's share of the file: whole lines from start to end.
+// Only the chunk at the end of the file can finish without a newline; that
+// line is left in tail, since it can't be terminated in place.
+typedef struct {
+    char* start;
+    char* end;
+    SeedView* views;
+    size_t count;
+    size_t capacity;
+    size_t invalid;
+    int failed;
+    SeedView tail;
+} SeedChunk;
+
+// Free list of reusable buffers
+typedef struct {
+    char* buffers[MAX_POOLED_BUFFERS];
+    size_t capacities[MAX_POOLED_BUFFERS];
+    int count;
+    pthread_mutex_t lock;
+} BufferPool;
+
+// Bytes held in transfer buffers across every worker. One transfer at a time
+// may overdraw the limit, so a body that needs more than is free still
+// finishes and releases its share. releases counts budgetReturn calls, so
+// event loops can tell whether memory was freed since they last looked.
+typedef struct {
+    uint64_t limit;
+    uint64_t used;
+    uint64_t peak;
+    uint64_t releases;
+    int overdrawn;
+    pthread_mutex_t lock;
+    pthread_cond_t freed;
+} MemoryBudget;
+
+// Free list of reusable compression contexts
+typedef struct {
+    void* items[MAX_POOLED_BUFFERS];
+    int count;
+    pthread_mutex_t lock;
+} CompressorPool;
+
+// Incremental href extractor for one transfer. base is the page URL that
+// relative links resolve against; host is its host name.
+typedef struct {
+    int state;
+    int match;
+    char quote;
+    int afterSpace;
+    int afterEquals;
+    char value[MAX_URL_LENGTH];
+    size_t valueLength;
+    int overflow;
+    CURLU* base;
+    char* host;
+} LinkScanner;
+
+// One shard of the URL-seen set: open addressing over 64-bit URL keys
+typedef struct {
+    uint64_t* keys;
+    int count;
+    int capacity;
+    pthread_mutex_t lock;
+} SeenShard;
+
+// Streaming XXH64 state: four lanes plus up to one partial 32-byte stripe
+typedef struct {
+    uint64_t lanes[4];
+    uint64_t totalLength;
+    unsigned char buffer[32];
+    size_t buffered;
+} Xxh64State;
+
+// State for one transfer, shared by both fetch engines. In stream mode
+// chunk is a fixed staging buffer flushed to fd; in memory mode it holds
+// the whole body. With compression on, the staging buffer holds compressed
+// bytes and rawSize counts the decoded body. budgetHeld is what the chunk
+// is charged against the memory budget; loop is NULL on the thread engine.
+typedef struct {
+    ThreadData* job;
+    CURL* curl;
+    struct EventLoop* loop;
+    MemoryStruct chunk;
+    size_t budgetHeld;
+    int overdraft;
+    int paused;
+    int tooLarge;
+    char outputPath[MAX_PATH_LENGTH];
+    int fd;
+    int direct;
+    size_t written;
+    size_t rawSize;
+    int writeFailed;
+    void* compressor;
+    struct curl_slist* headers;
+    int cacheEntry;
+    uint64_t cachedSize;
+    uint64_t contentHash;
+    Xxh64State hashState;
+    void* digest;
+    char objectName[CAS_NAME_LENGTH];
+    char etag[MAX_VALIDATOR_LENGTH];
+    char lastModified[MAX_VALIDATOR_LENGTH];
+    LinkScanner links;
+    struct curl_slist* resolve;
+} Transfer;
+
+// Scheduling state for one host. The origin and name point into the URL of
+// the first job seen for the host. Queued jobs are linked through
+// ThreadData.nextInHost.
+typedef struct {
+    const char* origin;
+    const char* name;
+    uint32_t originLength;
+    uint32_t nameLength;
+    int head;
+    int tail;
+    int queued;
+    int active;
+    double rate;
+    double burst;
+    double tokens;
+    uint64_t refillTime;
+    uint64_t lastStart;
+    uint64_t readyTime;
+    int heapSlot;
+    int multiplexed;
+    int robotsPending;
+} HostState;
+
+// What the last run saved for one URL. Strings live in the cache arena;
+// missing validators are empty strings.
+typedef struct {
+    const char* url;
+    uint32_t urlLength;
+    const char* etag;
+    const char* lastModified;
+    const char* path;
+    uint64_t contentHash;
+    uint64_t size;
+    uint64_t storedSize;
+} CacheEntry;
+
+// Persistent URL -> CacheEntry index, loaded at startup and saved after
+// each run
+typedef struct {
+    CacheEntry* entries;
+    int count;
+    int capacity;
+    int* table;
+    int tableSize;
+    ArenaBlock* arena;
+    pthread_mutex_t lock;
+} CacheIndex;
+
+// Segment writer owned by one worker, so appends need no locking
+typedef struct {
+    int fd;
+    int sequence;
+    uint64_t size;
+} ArchiveWriter;
+
+// One line of the archive index while it is being merged
+typedef struct {
+    const char* text;
+    size_t length;
+    int order;
+} IndexLine;
+
+// Cached lookup for one host name. Entries waiting for a resolver thread
+// are linked through next.
+typedef struct {
+    const char* name;
+    uint32_t nameLength;
+    int state;
+    uint64_t expires;
+    int next;
+    char addresses[DNS_ADDRESS_LENGTH];
+} DnsEntry;
+
+// Host name -> addresses cache shared by all workers, plus the queue of
+// names the resolver threads still have to look up
+typedef struct {
+    DnsEntry* entries;
+    int count;
+    int capacity;
+    int* table;
+    int tableSize;
+    ArenaBlock* arena;
+    int queueHead;
+    int queueTail;
+    int stopping;
+    pthread_t threads[MAX_DNS_THREADS];
+    int threadCount;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+} DnsCache;
+
+// Failed job waiting for its retry time
+typedef struct {
+    uint64_t dueTime;
+    int jobIndex;
+} RetryEntry;
+
+// Shared work queue of job indices into the job store, scheduled per host.
+// A host sits in the ready heap while it has queued jobs and is below the
+// per-host connection cap; the heap is ordered by when its next token is due.
+// Jobs backing off after a failure wait in a second heap ordered by due time
+// and still count as pending. With robotsGate set, hosts from robotsNext on
+// are still waiting for the robots.txt thread.
+typedef struct {
+    HostState* hosts;
+    int hostCount;
+    int hostCapacity;
+    int* hostTable;
+    int tableSize;
+    int* heap;
+    int heapSize;
+    RetryEntry* retries;
+    int retryCount;
+    int retryCapacity;
+    int count;
+    int pending;
+    int robotsGate;
+    int robotsNext;
+    int robotsApplied;
+    int robotsStopping;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t robotsWake;
+} JobQueue;
+
+// One robots.txt fetch in flight
+typedef struct {
+    int hostIndex;
+    MemoryStruct body;
+} RobotsFetch;
+
+// Structure passed to each pool worker
+typedef struct {
+    int workerID;
+    JobQueue* queue;
+} WorkerContext;
+
+// Distribution of one timing phase across a run (microseconds)
+typedef struct {
+    int count;
+    double mean;
+    uint32_t p50;
+    uint32_t p95;
+    uint32_t p99;
+    uint32_t max;
+    uint32_t histogram[HISTOGRAM_BUCKETS];
+} PhaseStats;
+
+// Backoff for one retry class: the first retry waits about baseMs, and each
+// later one doubles it
+typedef struct {
+    const char* name;
+    long baseMs;
+} RetryPolicy;
+
+// Throughput and latency figures for one scraping run
+typedef struct {
+    int jobs;
+    int succeeded;
+    int failed;
+    int retries;
+    int unchanged;
+    int duplicates;
+    int resumed;
+    size_t bytes;
+    uint64_t peakBuffered;
+    double seconds;
+    double pagesPerSecond;
+    double bytesPerSecond;
+    double p50Ms;
+    double p95Ms;
+    double p99Ms;
+    PhaseStats phases[PHASE_COUNT];
+} RunStats;
+
+// Progress counters written by one worker and read by the reporter thread.
+// Each sits on its own cache line so workers never share one.
+typedef struct {
+    uint64_t started;
+    uint64_t succeeded;
+    uint64_t failed;
+    uint64_t retried;
+    uint64_t bytes;
+} __attribute__((aligned(CACHE_LINE_SIZE))) WorkerCounters;
+
+// Thread that prints the live progress line and writes the metrics file
+typedef struct {
+    pthread_t thread;
+    int running;
+    int stopping;
+    int showLine;
+    uint64_t startTime;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} ProgressReporter;
+
+// One client connection to the benchmark's mock server
+typedef struct {
+    char request[BENCH_REQUEST_LIMIT];
+    size_t requestLength;
+    MemoryStruct response;
+    size_t sent;
+    int waiting;
+    int closed;
+    uint64_t dueTime;
+} BenchConnection;
+
+// Append-only log of crawl progress. Workers queue records in pending; the
+// commit thread swaps in the writing buffer and syncs each batch once.
+typedef struct {
+    int fd;
+    MemoryStruct pending;
+    MemoryStruct writing;
+    uint64_t records;
+    pthread_t thread;
+    int running;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} CheckpointJournal;
+
+// Downloaded page waiting for the extraction stage. It owns the body buffer
+// and its share of the memory budget; base is the URL links resolve against.
+typedef struct {
+    ThreadData* job;
+    MemoryStruct body;
+    char* base;
+    size_t budgetHeld;
+    int overdraft;
+} ExtractItem;
+
+// Queue between the fetch workers and the extraction threads, which append
+// one JSON line per page to output. Worker threads wait while it holds
+// EXTRACT_QUEUE_SIZE pages; event loops stop admitting jobs instead, and
+// pages from their transfers already in flight grow the ring past that.
+typedef struct {
+    ExtractItem* items;
+    int capacity;
+    int head;
+    int count;
+    int stopping;
+    pthread_t threads[MAX_EXTRACT_THREADS];
+    int threadCount;
+    FILE* output;
+    uint64_t records;
+    pthread_mutex_t lock;
+    pthread_mutex_t outputLock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+} ExtractStage;
+
+// Structure for one curl_multi event loop thread. Transfers paused for want
+// of memory wait in paused until the budget has room again.
+typedef struct EventLoop {
+    int workerID;
+    JobQueue* queue;
+    CURLM* multi;
+    int epollFd;
+    long timerDeadline;
+    int inFlight;
+    CURL** idleHandles;
+    int idleCount;
+    Transfer** paused;
+    int pausedCount;
+    uint64_t releasesSeen;
+} EventLoop;
+
 // Global variables
-ThreadData* threadDataArray = NULL;
+ThreadData* jobBlocks[MAX_JOB_BLOCKS];
+ArenaBlock* urlArena = NULL;
+char* seedMap = NULL;
+size_t seedMapLength = 0;
 int urlCount = 0;
+int workerCount = 0;
+int engineMode = ENGINE_THREADS;
+int maxInFlight = DEFAULT_MAX_INFLIGHT;
+int http2Mode = 0;
+int maxStreams = DEFAULT_MAX_STREAMS;
+int storeMode = STORE_STREAM;
+int directIO = 0;
+uint64_t memoryBudget = (uint64_t)DEFAULT_MEMORY_BUDGET_MB * 1024 * 1024;
+uint64_t maxBodySize = 0;
+char outputDir[MAX_PATH_LENGTH - 64] = OUTPUT_DIR;
+long requestTimeoutMs = 30000;
+long connectTimeoutMs = 0;
+const char* seedFile = NULL;
+int batchMode = 0;
+const char* timingsFile = NULL;
+int maxPerHost = DEFAULT_MAX_PER_HOST;
+double hostRate = 0.0;
+double hostBurst = DEFAULT_HOST_BURST;
+int robotsMode = 0;
+int maxRetries = DEFAULT_MAX_RETRIES;
+int cacheEnabled = 1;
+int compressMode = COMPRESS_NONE;
+int zstdLevel = DEFAULT_ZSTD_LEVEL;
+const char* zstdDictFile = NULL;
+int archiveMode = 0;
+uint64_t segmentSize = (uint64_t)DEFAULT_SEGMENT_MB * 1024 * 1024;
+const char* archiveGetURL = NULL;
+int crawlDepth = 0;
+int sameHostOnly = 0;
+int maxPages = 0;
+int verboseMode = 0;
+int progressMode = 1;
+const char* metricsFile = NULL;
+int casMode = 0;
+int casHash = DEFAULT_CAS_HASH;
+int checkpointMode = 0;
+const char* extractFile = NULL;
+int extractThreads = DEFAULT_EXTRACT_THREADS;
+int dnsThreads = DEFAULT_DNS_THREADS;
+long dnsTtl = DEFAULT_DNS_TTL;
+int benchMode = 0;
+const char* benchLevels = DEFAULT_BENCH_LEVELS;
+int benchRequests = DEFAULT_BENCH_REQUESTS;
+double benchLatencyMs = 0.0;
+size_t benchBodyMin = DEFAULT_BENCH_BODY;
+size_t benchBodyMax = DEFAULT_BENCH_BODY;
+double benchErrorRate = 0.0;
+int benchChunked = 0;
+char* benchBody = NULL;
+
+const RetryPolicy retryPolicies[RETRY_CLASSES] = {
+    {"none", 0},
+    {"timeout", 2000},
+    {"server error", 1000},
+    {"connection error", 500}
+};
+
+const char* phaseNames[PHASE_COUNT] = {"dns", "connect", "tls", "server", "transfer", "total"};
+
+// Recycled body buffers (memory mode) and aligned staging buffers (stream mode)
+BufferPool bodyPool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+BufferPool stagingPool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+MemoryBudget budget = { .lock = PTHREAD_MUTEX_INITIALIZER, .freed = PTHREAD_COND_INITIALIZER };
+pthread_mutex_t urlLock = PTHREAD_MUTEX_INITIALIZER;
+CacheIndex cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+CompressorPool compressorPool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+ArchiveWriter archiveWriters[MAX_WORKERS];
+int archivePendingFd = -1;
+SeenShard seenShards[SEEN_SHARDS];
+DnsCache dnsCache;
+WorkerCounters workerCounters[MAX_WORKERS];
+ProgressReporter reporter;
+CheckpointJournal journal = { .fd = -1 };
+ExtractStage extractStage = { .lock = PTHREAD_MUTEX_INITIALIZER, .outputLock = PTHREAD_MUTEX_INITIALIZER,
+                              .notEmpty = PTHREAD_COND_INITIALIZER, .notFull = PTHREAD_COND_INITIALIZER };
+FILE* casManifest = NULL;
+pthread_mutex_t casLock = PTHREAD_MUTEX_INITIALIZER;
+#ifdef HAVE_ZSTD
+ZSTD_CDict* zstdDict = NULL;
+#endif
+JobQueue* activeQueue = NULL;
+
+// DNS and TLS session state shared by every handle, kept for the life of
+// the process so repeated scrapes of the same hosts reuse it
+CURLSH* shareHandle = NULL;
+pthread_mutex_t shareLocks[CURL_LOCK_DATA_LAST];
+
+// Persistent easy handles for the thread-pool engine, indexed by worker ID
+CURL* workerHandles[MAX_WORKERS];
 
 // Function prototypes
 void initializeSystem();
@@ -48,29 +755,278 @@ void cleanupSystem();
 void createOutputDirectory();
 void addURLs();
 void startScraping();
+int64_t runScrape();
+void computeRunStats(RunStats* stats, uint64_t elapsedNanos);
+void printRunStats(const RunStats* stats);
+void printRunStatsJSON(const RunStats* stats);
+int runBatch();
+int runBenchmark();
+int benchLevel(int concurrency, int port, RunStats* stats);
+void benchRemoveTree(const char* path);
+void benchServe(int listenFd);
+int benchRespond(BenchConnection* connection);
+int benchSend(int epollFd, int fd, BenchConnection* connection);
+void recordTimings(ThreadData* data, CURL* curl);
+void computePhaseStats(PhaseStats* phase, int phaseIndex, uint64_t* scratch);
+int histogramBucket(uint32_t micros);
+void printPhaseStats(const RunStats* stats);
+int writeTimingRecords(const char* path);
+void writeJSONString(FILE* file, const char* text, size_t length);
+double percentile(const uint64_t* sorted, int count, double fraction);
+int compareUint64(const void* a, const void* b);
+int makeDirectories(const char* path);
+void jobLog(const char* format, ...);
+void workerLog(const char* format, ...);
+void progressJobStarted(ThreadData* data);
+void progressJobFinished(ThreadData* data, uint64_t retryDelay);
+void progressSample(WorkerCounters* total);
+void progressStart();
+void progressStop();
+void* progressMain(void* arg);
+int writeMetrics(const char* path, const WorkerCounters* total, uint64_t now);
 void displayResults();
 void saveURLsToFile();
 void loadURLsFromFile();
-void* scrapeURL(void* arg);
+int loadSeedFile(const char* filename);
+ThreadData* jobAt(int index);
+int jobAppend(const char* url, size_t length);
+int jobInsert(const char* url, size_t length);
+int loadSeedMapped(int fd, size_t size);
+int loadSeedStream(FILE* file);
+void* seedScanChunk(void* arg);
+int seedLineValid(const char* line, size_t length);
+void jobStoreReset();
+const char* arenaIntern(ArenaBlock** arena, const char* text, size_t length);
+void jobOutputPath(const ThreadData* data, char* path, size_t size);
+uint64_t hashBytes(uint64_t hash, const void* data, size_t length);
+void cacheIndexPath(char* path, size_t size);
+int cacheFind(const char* url, size_t length);
+int cacheStore(const char* url, size_t urlLength, const char* etag, const char* lastModified,
+               const char* path, uint64_t contentHash, uint64_t size, uint64_t storedSize);
+int cacheLoad();
+int cacheSave();
+void cacheReset();
+void cacheAddValidators(Transfer* transfer, ThreadData* data);
+void cacheRecord(Transfer* transfer, uint64_t size, uint64_t storedSize);
+size_t headerCallback(char* buffer, size_t size, size_t nitems, void* userp);
+int headerValue(const char* line, size_t length, const char* name, char* value, size_t size);
+int parseOptions(int argc, char* argv[]);
+void printUsage(const char* program);
+int defaultWorkerCount();
+int queueInit(JobQueue* queue);
+void queueDestroy(JobQueue* queue);
+int queuePush(JobQueue* queue, int jobIndex);
+int queuePop(JobQueue* queue, int* jobIndex);
+int queueTryPop(JobQueue* queue, int* jobIndex);
+void queueJobDone(JobQueue* queue, int jobIndex);
+int queueRetry(JobQueue* queue, int jobIndex, uint64_t delayNanos);
+void queueReleaseRetries(JobQueue* queue, uint64_t now);
+int queueTake(JobQueue* queue, uint64_t now);
+void hostAppend(JobQueue* queue, int jobIndex, uint64_t now);
+uint32_t hostHash(const char* name, size_t length);
+int hostLookup(JobQueue* queue, ThreadData* data);
+void hostUpdate(JobQueue* queue, int hostIndex, uint64_t now);
+void hostSetCrawlDelay(HostState* host, double seconds);
+void heapSiftUp(JobQueue* queue, int slot);
+void heapSiftDown(JobQueue* queue, int slot);
+void heapRemove(JobQueue* queue, int slot);
+void urlHostPart(const char* url, size_t length, size_t* hostStart, size_t* hostLength, size_t* originLength);
+int robotsStart(JobQueue* queue, pthread_t* thread);
+void robotsStop(JobQueue* queue, pthread_t thread);
+void robotsRelease(JobQueue* queue, int hostIndex, double delay);
+void* robotsMain(void* arg);
+double parseCrawlDelay(const char* text, size_t length);
+int enqueueURL(const char* url);
+void linkScanInit(LinkScanner* scanner, ThreadData* data);
+void linkScanFree(LinkScanner* scanner);
+void linkScan(Transfer* transfer, const char* input, size_t length);
+void frontierAdd(Transfer* transfer, char* link);
+uint64_t urlKey(const char* url, size_t length);
+int seenInsert(uint64_t key);
+void seenAddSeed(const char* url, size_t length);
+void seenReset();
+void dnsStart();
+void dnsStop();
+void dnsPrefetch(const char* url, size_t length);
+int dnsWantsLookup(const char* name, size_t length);
+int dnsFind(const char* name, size_t length, int create);
+void dnsRefresh(int index, uint64_t now);
+void* dnsResolverMain(void* arg);
+int dnsLookup(const char* name, char* addresses, size_t size);
+void dnsAddResolve(Transfer* transfer, ThreadData* data);
+void* workerMain(void* arg);
+uint64_t scrapeURL(ThreadData* data, CURL* curl);
+void initializeShare();
+void cleanupShare();
+void shareLock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userp);
+void shareUnlock(CURL* handle, curl_lock_data data, void* userp);
+int transferSetup(Transfer* transfer, CURL* curl, ThreadData* data);
+uint64_t transferFinish(Transfer* transfer, CURLcode res);
+int retryClass(CURLcode res, long status);
+uint64_t retryDelay(ThreadData* data, CURL* curl, int retryType);
+uint64_t mix64(uint64_t x);
+void* eventLoopMain(void* arg);
+int eventLoopStart(EventLoop* loop, int jobIndex);
+void eventLoopPause(EventLoop* loop, Transfer* transfer);
+void eventLoopResume(EventLoop* loop);
+int socketCallback(CURL* easy, curl_socket_t s, int what, void* userp, void* socketp);
+int timerCallback(CURLM* multi, long timeoutMs, void* userp);
+long monotonicMillis();
+uint64_t monotonicNanos();
 size_t writeCallback(void* contents, size_t size, size_t nmemb, void* userp);
+size_t bodyCallback(void* contents, size_t size, size_t nmemb, void* userp);
+size_t streamCallback(void* contents, size_t size, size_t nmemb, void* userp);
+int streamOpen(Transfer* transfer);
+int streamFlush(Transfer* transfer, int final);
+int writeAll(int fd, const char* buffer, size_t length, off_t offset);
+int saveBody(const char* path, const char* tempPath, const char* buffer, size_t length);
+void tempPathFor(const char* path, char* tempPath, size_t size);
+int bufferAcquire(BufferPool* pool, MemoryStruct* mem, size_t minCapacity, int aligned);
+void bufferRelease(BufferPool* pool, MemoryStruct* mem);
+void bufferPoolCleanup(BufferPool* pool);
+size_t bufferGrowth(const MemoryStruct* mem, size_t needed);
+void budgetReset();
+int budgetReserve(Transfer* transfer, size_t bytes, int mode);
+void budgetRelease(Transfer* transfer);
+void budgetReturn(size_t bytes, int overdraft);
+int budgetAdmit(int mode);
+int compressInit();
+void compressCleanup();
+void* compressorAcquire();
+void compressorRelease(void* compressor);
+int compressStream(Transfer* transfer, const char* input, size_t length, int final);
+int compressBody(void* compressor, const MemoryStruct* body, MemoryStruct* packed);
+int decompressFrame(const char* data, size_t size, MemoryStruct* out);
+uint64_t rotl64(uint64_t x, int bits);
+uint64_t readLE64(const unsigned char* p);
+uint64_t xxh64Round(uint64_t acc, uint64_t input);
+void xxh64Reset(Xxh64State* state);
+void xxh64Update(Xxh64State* state, const void* data, size_t length);
+uint64_t xxh64Digest(const Xxh64State* state);
+int contentHashInit(Transfer* transfer);
+void contentHashUpdate(Transfer* transfer, const void* data, size_t length);
+void contentHashFree(Transfer* transfer);
+void contentHashName(Transfer* transfer, char* name, size_t size);
+int casResolve(Transfer* transfer, uint64_t storedSize);
+void casBegin();
+void casRecord(Transfer* transfer, size_t size);
+int casFinish();
+int extractStart();
+void extractSubmit(Transfer* transfer);
+int extractAdmit(int wait);
+void* extractMain(void* arg);
+int64_t extractStop();
+int extractPage(const ExtractItem* item, MemoryStruct* record);
+int tagNameIs(const char* name, size_t length, const char* wanted);
+int tagAttribute(const char* attributes, size_t length, const char* name, const char** value, size_t* valueLength);
+int extractLink(CURLU* base, const char* href, size_t length, MemoryStruct* links);
+int appendDecoded(MemoryStruct* out, const char* text, size_t length, int collapse);
+int appendDecodedJSON(MemoryStruct* out, const char* text, size_t length);
+int appendJSONString(MemoryStruct* out, const char* text, size_t length);
+size_t utf8Encode(uint32_t code, char* out);
+int htmlContentType(const char* contentType);
+void journalPath(char* path, size_t size, const char* name);
+int journalReplay(const char* path, int** table, size_t* tableSize);
+void journalApply(ThreadData* data, char type, const char* value);
+int journalOpen();
+void journalAppend(char type, uint64_t value, const char* url, size_t length);
+void journalJobAdded(ThreadData* data);
+void journalJobFinished(ThreadData* data, uint64_t retryDelay);
+int journalCommit();
+int journalSnapshot();
+void* journalMain(void* arg);
+int journalClose();
+int readWholeFile(const char* path, MemoryStruct* out);
+void archiveSegmentName(char* name, size_t size, int workerID, int sequence);
+int archiveBegin();
+int archiveOpenSegment(ArchiveWriter* writer, int workerID);
+int archiveAppend(int workerID, ThreadData* data, const MemoryStruct* body, const char* contentType, void* compressor);
+int archiveFinish();
+int archiveWriteIndex();
+int indexLineKeyCompare(const IndexLine* a, const IndexLine* b);
+int compareIndexLines(const void* a, const void* b);
+int archiveIndexLookup(const char* url, char* segment, unsigned long long* offset, unsigned long long* length);
+int archivePendingLookup(const char* url, char* segment, unsigned long long* offset, unsigned long long* length);
+int archiveGet(const char* url);
+const char* findBytes(const char* haystack, size_t length, const char* needle, size_t needleLength);
 void displayMenu();
 int getValidInteger(const char* prompt);
 void clearInputBuffer();
 char* getCurrentTimestamp();
 
-int main() {
+int main(int argc, char* argv[]) {
     int choice;
     
+    if (parseOptions(argc, argv) != 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    
+    if (compressInit() != 0) {
+        printf("Error: Could not load zstd dictionary '%s'.\n", zstdDictFile);
+        return 1;
+    }
+    
+    if (archiveGetURL != NULL) {
+        int status = archiveGet(archiveGetURL);
+        compressCleanup();
+        return status;
+    }
+    
+    // The benchmark forks a process per run, so it starts before curl or
+    // any thread exists
+    if (benchMode) {
+        int status = runBenchmark();
+        compressCleanup();
+        return status;
+    }
+    
     // Initialize curl globally
     curl_global_init(CURL_GLOBAL_DEFAULT);
+    initializeShare();
+    dnsStart();
     
     initializeSystem();
     createOutputDirectory();
+    if (cacheEnabled) {
+        cacheLoad();
+    }
+    
+    if (batchMode) {
+        int status = runBatch();
+        cleanupSystem();
+        cleanupShare();
+        dnsStop();
+        bufferPoolCleanup(&bodyPool);
+        bufferPoolCleanup(&stagingPool);
+        compressCleanup();
+        curl_global_cleanup();
+        return status;
+    }
     
     printf("\n====================================================\n");
     printf("       MULTI-THREADED WEB SCRAPER\n");
     printf("====================================================\n");
-    printf("Output directory: %s/\n", OUTPUT_DIR);
+    printf("Output directory: %s/\n", outputDir);
+    if (engineMode == ENGINE_MULTI) {
+        printf("Fetch engine:     curl_multi + epoll\n");
+        printf("Event loops:      %d (up to %d transfers each)\n", workerCount, maxInFlight);
+        if (http2Mode) {
+            printf("HTTP/2:           up to %d streams per connection\n", maxStreams);
+        }
+    } else {
+        printf("Fetch engine:     worker threads\n");
+        printf("Worker threads:   %d\n", workerCount);
+    }
+    if (maxPerHost > 0) {
+        printf("Per host:         %d connection(s)", maxPerHost);
+    } else {
+        printf("Per host:         no connection cap");
+    }
+    if (hostRate > 0) {
+        printf(", %.2f req/s", hostRate);
+    }
+    printf("%s\n", robotsMode ? ", robots.txt Crawl-delay" : "");
     printf("====================================================\n");
     
     while (1) {
@@ -95,6 +1051,11 @@ int main() {
                 break;
             case 6:
                 cleanupSystem();
+                cleanupShare();
+                dnsStop();
+                bufferPoolCleanup(&bodyPool);
+                bufferPoolCleanup(&stagingPool);
+                compressCleanup();
                 curl_global_cleanup();
                 printf("\nExiting program. Goodbye!\n");
                 return 0;
@@ -112,54 +1073,62 @@ int main() {
 
 // Initialize the system
 void initializeSystem() {
-    threadDataArray = (ThreadData*)malloc(MAX_URLS * sizeof(ThreadData));
-    if (threadDataArray == NULL) {
-        printf("Memory allocation failed!\n");
-        exit(1);
-    }
+    memset(jobBlocks, 0, sizeof(jobBlocks));
+    urlArena = NULL;
+    urlCount = 0;
     
-    for (int i = 0; i < MAX_URLS; i++) {
-        threadDataArray[i].threadID = -1;
-        threadDataArray[i].url[0] = '\0';
-        threadDataArray[i].outputFile[0] = '\0';
-        threadDataArray[i].success = 0;
-        threadDataArray[i].dataSize = 0;
+    for (int i = 0; i < SEEN_SHARDS; i++) {
+        pthread_mutex_init(&seenShards[i].lock, NULL);
     }
-    
-    urlCount = 0;
 }
 
 // Cleanup system resources
 void cleanupSystem() {
-    if (threadDataArray != NULL) {
-        free(threadDataArray);
-        threadDataArray = NULL;
-    }
-    urlCount = 0;
+    jobStoreReset();
+    cacheReset();
+    seenReset();
 }
 
 // Create output directory if it doesn't exist
 void createOutputDirectory() {
-    char command[200];
-    sprintf(command, "mkdir -p %s", OUTPUT_DIR);
-    system(command);
+    if (makeDirectories(outputDir) != 0) {
+        printf("Warning: could not create output directory '%s'.\n", outputDir);
+    }
+}
+
+// mkdir -p: create a directory and any missing parents
+int makeDirectories(const char* path) {
+    char partial[MAX_PATH_LENGTH];
+    size_t length = strlen(path);
+    
+    if (length == 0 || length >= sizeof(partial)) {
+        return -1;
+    }
+    
+    memcpy(partial, path, length + 1);
+    for (size_t i = 1; i <= length; i++) {
+        if (partial[i] == '/' || partial[i] == '\0') {
+            char saved = partial[i];
+            partial[i] = '\0';
+            if (mkdir(partial, 0755) != 0 && errno != EEXIST) {
+                return -1;
+            }
+            partial[i] = saved;
+        }
+    }
+    return 0;
 }
 
 // Add URLs to scrape
 void addURLs() {
     printf("\n========== ADD URLs ==========\n");
     
-    if (urlCount >= MAX_URLS) {
-        printf("Maximum URL limit (%d) reached!\n", MAX_URLS);
-        return;
-    }
-    
-    printf("Current URLs: %d / %d\n", urlCount, MAX_URLS);
+    printf("Current URLs: %d\n", urlCount);
     printf("Enter URLs (one per line, empty line to finish):\n");
     
     clearInputBuffer();
     
-    while (urlCount < MAX_URLS) {
+    while (1) {
         printf("URL %d: ", urlCount + 1);
         
         char url[MAX_URL_LENGTH];
@@ -187,10 +1156,10 @@ void addURLs() {
         }
         
         // Add URL
-        strcpy(threadDataArray[urlCount].url, url);
-        threadDataArray[urlCount].threadID = urlCount;
-        sprintf(threadDataArray[urlCount].outputFile, "%s/page_%d.html", OUTPUT_DIR, urlCount + 1);
-        urlCount++;
+        if (jobAppend(url, strlen(url)) < 0) {
+            printf("Memory allocation failed!\n");
+            break;
+        }
         
         printf("URL added successfully!\n");
     }
@@ -198,7 +1167,7 @@ void addURLs() {
     printf("\nTotal URLs: %d\n", urlCount);
 }
 
-// Start multi-threaded scraping
+// Start multi-threaded scraping with a fixed-size worker pool
 void startScraping() {
     printf("\n========== START SCRAPING ==========\n");
     
@@ -207,203 +1176,6120 @@ void startScraping() {
         return;
     }
     
-    printf("Starting scraping of %d URLs using %d threads...\n", urlCount, urlCount);
+    int poolSize = workerCount < urlCount || crawlDepth > 0 ? workerCount : urlCount;
+    
+    if (engineMode == ENGINE_MULTI) {
+        printf("Starting scraping of %d URLs using %d event loop(s), %d transfers each...\n",
+               urlCount, poolSize, maxInFlight);
+    } else {
+        printf("Starting scraping of %d URLs using %d worker threads...\n", urlCount, poolSize);
+    }
     printf("This may take a moment...\n\n");
     
-    pthread_t* threads = (pthread_t*)malloc(urlCount * sizeof(pthread_t));
-    if (threads == NULL) {
-        printf("Failed to allocate memory for threads!\n");
+    int64_t elapsed = runScrape();
+    if (elapsed < 0) {
         return;
     }
     
-    // Create threads
-    time_t overallStart = time(NULL);
+    // Display summary
+    RunStats stats;
+    computeRunStats(&stats, (uint64_t)elapsed);
+    
+    printf("\n========== SCRAPING SUMMARY ==========\n");
+    printRunStats(&stats);
+    printPhaseStats(&stats);
+    printf("======================================\n");
     
-    for (int i = 0; i < urlCount; i++) {
-        threadDataArray[i].startTime = time(NULL);
-        
-        if (pthread_create(&threads[i], NULL, scrapeURL, &threadDataArray[i]) != 0) {
-            printf("Error creating thread %d\n", i);
-            threadDataArray[i].success = 0;
+    if (timingsFile != NULL) {
+        if (writeTimingRecords(timingsFile) == 0) {
+            printf("Per-request timings written to '%s'.\n", timingsFile);
         } else {
-            printf("Thread %d started for: %s\n", i + 1, threadDataArray[i].url);
+            printf("Error: Could not write timings to '%s'.\n", timingsFile);
         }
     }
+}
+
+// Run every job through the worker pool and wait for it to drain.
+// Returns the wall time in nanoseconds, or -1 if the pool couldn't start.
+int64_t runScrape() {
+    JobQueue queue;
+    if (queueInit(&queue) != 0) {
+        printf("Failed to allocate memory for job queue!\n");
+        return -1;
+    }
     
-    // Wait for all threads to complete
-    printf("\nWaiting for threads to complete...\n");
+    // A crawl can grow well past its seeds, so it starts the whole pool
+    int poolSize = workerCount < urlCount || crawlDepth > 0 ? workerCount : urlCount;
     
-    for (int i = 0; i < urlCount; i++) {
-        pthread_join(threads[i], NULL);
-        printf("Thread %d completed.\n", i + 1);
+    pthread_t* threads = (pthread_t*)malloc(poolSize * sizeof(pthread_t));
+    WorkerContext* contexts = (WorkerContext*)malloc(poolSize * sizeof(WorkerContext));
+    EventLoop* loops = (EventLoop*)malloc(poolSize * sizeof(EventLoop));
+    if (threads == NULL || contexts == NULL || loops == NULL) {
+        printf("Failed to allocate memory for threads!\n");
+        free(threads);
+        free(contexts);
+        free(loops);
+        queueDestroy(&queue);
+        return -1;
     }
     
-    time_t overallEnd = time(NULL);
+    uint64_t overallStart = monotonicNanos();
+    budgetReset();
     
-    free(threads);
+    // Pick up where an interrupted run stopped
+    if (checkpointMode) {
+        int resumed = journalOpen();
+        if (resumed < 0) {
+            jobLog("Warning: could not open the checkpoint journal; progress won't be saved.\n");
+        } else if (resumed > 0) {
+            jobLog("Resuming: %d of %d pages already done.\n", resumed, urlCount);
+        }
+    }
     
-    // Display summary
-    printf("\n========== SCRAPING SUMMARY ==========\n");
-    printf("Total time: %ld seconds\n", overallEnd - overallStart);
+    // Links back to pages already in the list are not queued again
+    seenReset();
+    if (crawlDepth > 0) {
+        for (int i = 0; i < urlCount; i++) {
+            seenAddSeed(jobAt(i)->url, jobAt(i)->urlLength);
+        }
+    }
     
-    int successCount = 0;
-    size_t totalData = 0;
+    // With --robots, no host is fetched before its robots.txt
+    queue.robotsGate = robotsMode;
     
-    for (int i = 0; i < urlCount; i++) {
-        if (threadDataArray[i].success) {
-            successCount++;
-            totalData += threadDataArray[i].dataSize;
+    // Queue every job before the workers start pulling
+    int initialCount = urlCount;
+    for (int i = 0; i < initialCount; i++) {
+        ThreadData* data = jobAt(i);
+        data->workerID = -1;
+        data->startTime = 0;
+        data->endTime = 0;
+        data->attempts = 0;
+        memset(data->phaseMicros, 0, sizeof(data->phaseMicros));
+        if (data->resumed) {
+            continue;
         }
+        data->success = 0;
+        data->dataSize = 0;
+        data->notModified = 0;
+        data->duplicate = 0;
+        queuePush(&queue, i);
     }
+    activeQueue = &queue;
     
-    printf("Successful: %d / %d\n", successCount, urlCount);
-    printf("Failed: %d / %d\n", urlCount - successCount, urlCount);
-    printf("Total data downloaded: %zu bytes (%.2f KB)\n", totalData, totalData / 1024.0);
-    printf("======================================\n");
-}
-
-// Thread function to scrape a single URL
-void* scrapeURL(void* arg) {
-    ThreadData* data = (ThreadData*)arg;
-    CURL* curl;
-    CURLcode res;
-    MemoryStruct chunk;
+    if (archiveMode && archiveBegin() != 0) {
+        jobLog("Warning: could not open the archive index; pages won't be archived.\n");
+    }
+    if (casMode) {
+        casBegin();
+    }
     
-    chunk.data = malloc(1);
-    chunk.size = 0;
+    int extracting = extractFile != NULL && extractStart() == 0;
+    if (extractFile != NULL && !extracting) {
+        jobLog("Warning: could not start extraction to '%s'.\n", extractFile);
+    }
     
-    curl = curl_easy_init();
+    pthread_t robotsThread;
+    int robots = robotsMode && robotsStart(&queue, &robotsThread) == 0;
+    if (robotsMode && !robots) {
+        jobLog("Warning: could not fetch robots.txt; crawl delays not applied.\n");
+    }
     
-    if (curl) {
-        // Set URL
-        curl_easy_setopt(curl, CURLOPT_URL, data->url);
-        
-        // Set callback function
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&chunk);
-        
-        // Follow redirects
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        
-        // Set timeout (30 seconds)
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
-        
-        // Set user agent
-        curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0 (Web Scraper/1.0)");
-        
-        // Perform the request
-        res = curl_easy_perform(curl);
+    progressStart();
+    
+    // Create worker pool
+    int started = 0;
+    for (int i = 0; i < poolSize; i++) {
+        int rc;
         
-        if (res != CURLE_OK) {
-            printf("Thread %d ERROR: %s\n", data->threadID + 1, curl_easy_strerror(res));
-            data->success = 0;
+        if (engineMode == ENGINE_MULTI) {
+            memset(&loops[i], 0, sizeof(EventLoop));
+            loops[i].workerID = i;
+            loops[i].queue = &queue;
+            rc = pthread_create(&threads[started], NULL, eventLoopMain, &loops[i]);
         } else {
-            // Save to file
-            FILE* file = fopen(data->outputFile, "w");
-            if (file == NULL) {
-                printf("Thread %d ERROR: Could not create output file\n", data->threadID + 1);
-                data->success = 0;
-            } else {
-                fwrite(chunk.data, 1, chunk.size, file);
-                fclose(file);
-                
-                data->success = 1;
-                data->dataSize = chunk.size;
-                
-                printf("Thread %d SUCCESS: Downloaded %zu bytes\n", 
-                       data->threadID + 1, chunk.size);
-            }
+            contexts[i].workerID = i;
+            contexts[i].queue = &queue;
+            rc = pthread_create(&threads[started], NULL, workerMain, &contexts[i]);
         }
         
-        curl_easy_cleanup(curl);
-    } else {
-        printf("Thread %d ERROR: Failed to initialize curl\n", data->threadID + 1);
-        data->success = 0;
+        if (rc != 0) {
+            jobLog("Error creating worker %d\n", i + 1);
+        } else {
+            started++;
+        }
     }
     
-    data->endTime = time(NULL);
+    if (started == 0) {
+        // No workers could be created; drain the queue on this thread
+        jobLog("Falling back to scraping on the main thread.\n");
+        if (engineMode == ENGINE_MULTI) {
+            memset(&loops[0], 0, sizeof(EventLoop));
+            loops[0].queue = &queue;
+            eventLoopMain(&loops[0]);
+        } else {
+            WorkerContext self = {0, &queue};
+            workerMain(&self);
+        }
+    }
     
-    free(chunk.data);
+    // Wait for the pool to drain the queue
+    jobLog("\nWaiting for workers to complete...\n");
     
-    pthread_exit(NULL);
-}
-
-// Callback function for curl to write data
-size_t writeCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-    size_t realsize = size * nmemb;
-    MemoryStruct* mem = (MemoryStruct*)userp;
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    progressStop();
+    if (robots) {
+        robotsStop(&queue, robotsThread);
+    }
     
-    char* ptr = realloc(mem->data, mem->size + realsize + 1);
-    if (ptr == NULL) {
-        printf("Not enough memory (realloc returned NULL)\n");
-        return 0;
+    // Parsing overlaps fetching, so only the pages still queued are left
+    if (extracting) {
+        int64_t records = extractStop();
+        if (records < 0) {
+            jobLog("Warning: could not write extracted records to '%s'.\n", extractFile);
+        } else {
+            jobLog("Extracted %lld page(s) to '%s'.\n", (long long)records, extractFile);
+        }
     }
     
-    mem->data = ptr;
-    memcpy(&(mem->data[mem->size]), contents, realsize);
-    mem->size += realsize;
-    mem->data[mem->size] = 0;
+    uint64_t overallEnd = monotonicNanos();
     
-    return realsize;
-}
-
-// Display scraping results
-void displayResults() {
-    printf("\n========== SCRAPING RESULTS ==========\n");
+    if (checkpointMode && journalClose() != 0) {
+        jobLog("Warning: could not write the checkpoint snapshot.\n");
+    }
     
-    if (urlCount == 0) {
-        printf("No scraping results available.\n");
-        return;
+    if (cacheEnabled && cacheSave() != 0) {
+        jobLog("Warning: could not save the cache index.\n");
+    }
+    if (archiveMode && archiveFinish() != 0) {
+        jobLog("Warning: could not write the archive index.\n");
+    }
+    if (casMode && casFinish() != 0) {
+        jobLog("Warning: could not write the object manifest.\n");
     }
     
-    printf("%-4s %-10s %-50s %-15s %-10s\n", "ID", "Status", "URL", "Output File", "Size (KB)");
-    printf("--------------------------------------------------------------------------------------------------\n");
+    activeQueue = NULL;
+    free(threads);
+    free(contexts);
+    free(loops);
+    queueDestroy(&queue);
+    
+    return (int64_t)(overallEnd - overallStart);
+}
+
+// Summarize the jobs of the last run
+void computeRunStats(RunStats* stats, uint64_t elapsedNanos) {
+    memset(stats, 0, sizeof(RunStats));
+    stats->jobs = urlCount;
+    stats->seconds = elapsedNanos / 1e9;
+    stats->peakBuffered = budget.peak;
+    
+    uint64_t* latencies = (uint64_t*)malloc((urlCount > 0 ? urlCount : 1) * sizeof(uint64_t));
+    int latencyCount = 0;
     
     for (int i = 0; i < urlCount; i++) {
-        ThreadData* data = &threadDataArray[i];
-        
-        if (data->threadID == -1) continue;
-        
-        char statusStr[10];
+        ThreadData* data = jobAt(i);
+        if (data->resumed) {
+            stats->resumed++;
+            continue;
+        }
         if (data->success) {
-            strcpy(statusStr, "SUCCESS");
-        } else {
-            strcpy(statusStr, "FAILED");
+            stats->succeeded++;
         }
-        
-        // Truncate URL if too long
-        char truncatedURL[51];
-        if (strlen(data->url) > 47) {
-            strncpy(truncatedURL, data->url, 47);
-            truncatedURL[47] = '.';
-            truncatedURL[48] = '.';
-            truncatedURL[49] = '.';
-            truncatedURL[50] = '\0';
-        } else {
-            strcpy(truncatedURL, data->url);
+        if (data->duplicate) {
+            stats->duplicates++;
         }
-        
-        // Truncate filename if too long
-        char truncatedFile[16];
-        if (strlen(data->outputFile) > 12) {
-            strncpy(truncatedFile, data->outputFile, 12);
-            truncatedFile[12] = '.';
-            truncatedFile[13] = '.';
-            truncatedFile[14] = '.';
-            truncatedFile[15] = '\0';
-        } else {
-            strcpy(truncatedFile, data->outputFile);
+        if (data->notModified) {
+            stats->unchanged++;
+        } else if (data->success) {
+            stats->bytes += data->dataSize;
+        }
+        stats->retries += data->attempts;
+        if (latencies != NULL && data->endTime > data->startTime && data->startTime != 0) {
+            latencies[latencyCount++] = data->endTime - data->startTime;
         }
-        
-        printf("%-4d %-10s %-50s %-15s %-10.2f\n",
-               i + 1,
-               statusStr,
-               truncatedURL,
-               truncatedFile,
-               data->dataSize / 1024.0);
     }
+    stats->failed = stats->jobs - stats->succeeded - stats->resumed;
     
-    printf("==================================================================================================\n");
+    if (stats->seconds > 0) {
+        stats->pagesPerSecond = stats->succeeded / stats->seconds;
+        stats->bytesPerSecond = stats->bytes / stats->seconds;
+    }
+    
+    if (latencies != NULL) {
+        qsort(latencies, latencyCount, sizeof(uint64_t), compareUint64);
+        stats->p50Ms = percentile(latencies, latencyCount, 0.50) / 1e6;
+        stats->p95Ms = percentile(latencies, latencyCount, 0.95) / 1e6;
+        stats->p99Ms = percentile(latencies, latencyCount, 0.99) / 1e6;
+        
+        // Reuse the buffer for each phase in turn
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            computePhaseStats(&stats->phases[p], p, latencies);
+        }
+        free(latencies);
+    }
+}
+
+// Summarize one timing phase over every job that reached curl. TLS only
+// counts jobs that actually did a handshake.
+void computePhaseStats(PhaseStats* phase, int phaseIndex, uint64_t* scratch) {
+    uint64_t sum = 0;
+    
+    memset(phase, 0, sizeof(PhaseStats));
+    
+    for (int i = 0; i < urlCount; i++) {
+        ThreadData* data = jobAt(i);
+        uint32_t micros = data->phaseMicros[phaseIndex];
+        
+        if (data->phaseMicros[PHASE_TOTAL] == 0) {
+            continue;
+        }
+        if (phaseIndex == PHASE_TLS && micros == 0) {
+            continue;
+        }
+        
+        scratch[phase->count++] = micros;
+        sum += micros;
+        phase->histogram[histogramBucket(micros)]++;
+    }
+    
+    if (phase->count == 0) {
+        return;
+    }
+    
+    qsort(scratch, phase->count, sizeof(uint64_t), compareUint64);
+    phase->mean = (double)sum / phase->count;
+    phase->p50 = (uint32_t)percentile(scratch, phase->count, 0.50);
+    phase->p95 = (uint32_t)percentile(scratch, phase->count, 0.95);
+    phase->p99 = (uint32_t)percentile(scratch, phase->count, 0.99);
+    phase->max = (uint32_t)scratch[phase->count - 1];
+}
+
+// Log2 histogram bucket for a duration in microseconds
+int histogramBucket(uint32_t micros) {
+    int bucket = 0;
+    while (micros > 1 && bucket < HISTOGRAM_BUCKETS - 1) {
+        micros >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// Print the per-phase timing table and the total-time histogram
+void printPhaseStats(const RunStats* stats) {
+    printf("\nTiming breakdown (ms):\n");
+    printf("%-8s %8s %10s %10s %10s %10s %10s\n", "Phase", "Count", "Mean", "p50", "p95", "p99", "Max");
+    
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        const PhaseStats* phase = &stats->phases[p];
+        printf("%-8s %8d %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+               phaseNames[p], phase->count, phase->mean / 1000.0,
+               phase->p50 / 1000.0, phase->p95 / 1000.0, phase->p99 / 1000.0, phase->max / 1000.0);
+    }
+    
+    const PhaseStats* total = &stats->phases[PHASE_TOTAL];
+    if (total->count == 0) {
+        return;
+    }
+    
+    uint32_t largest = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        if (total->histogram[b] > largest) {
+            largest = total->histogram[b];
+        }
+    }
+    
+    printf("\nTotal time histogram:\n");
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        if (total->histogram[b] == 0) {
+            continue;
+        }
+        int width = (int)(40.0 * total->histogram[b] / largest);
+        printf("  < %10.3f ms %8u |", (double)(2ULL << b) / 1000.0, total->histogram[b]);
+        for (int i = 0; i < (width > 0 ? width : 1); i++) {
+            putchar('#');
+        }
+        putchar('\n');
+    }
+}
+
+// Write one JSON line per job with its timing breakdown
+int writeTimingRecords(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    
+    for (int i = 0; i < urlCount; i++) {
+        ThreadData* data = jobAt(i);
+        
+        fprintf(file, "{\"id\":%d,\"url\":", data->threadID + 1);
+        writeJSONString(file, data->url, data->urlLength);
+        fprintf(file, ",\"success\":%s,\"bytes\":%zu,\"attempts\":%d",
+                data->success ? "true" : "false", data->dataSize, data->attempts + 1);
+        fprintf(file, ",\"elapsed_ns\":%llu",
+                (unsigned long long)(data->endTime > data->startTime ? data->endTime - data->startTime : 0));
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            fprintf(file, ",\"%s_us\":%u", phaseNames[p], data->phaseMicros[p]);
+        }
+        fputs("}\n", file);
+    }
+    
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// Write a string as a quoted, escaped JSON string
+void writeJSONString(FILE* file, const char* text, size_t length) {
+    fputc('"', file);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            fputc('\\', file);
+            fputc(c, file);
+        } else if (c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+// Print run statistics for the interactive summary
+void printRunStats(const RunStats* stats) {
+    printf("Total time: %.3f seconds\n", stats->seconds);
+    printf("Successful: %d / %d\n", stats->succeeded, stats->jobs);
+    printf("Failed: %d / %d\n", stats->failed, stats->jobs);
+    printf("Retries: %d\n", stats->retries);
+    printf("Unchanged (304): %d\n", stats->unchanged);
+    printf("Duplicate bodies: %d\n", stats->duplicates);
+    printf("Resumed (done before restart): %d\n", stats->resumed);
+    printf("Total data downloaded: %zu bytes (%.2f KB)\n", stats->bytes, stats->bytes / 1024.0);
+    printf("Throughput: %.2f pages/sec, %.2f KB/sec\n", stats->pagesPerSecond, stats->bytesPerSecond / 1024.0);
+    printf("Latency (ms): p50 %.2f, p95 %.2f, p99 %.2f\n", stats->p50Ms, stats->p95Ms, stats->p99Ms);
+    printf("Peak buffered in flight: %.2f KB\n", stats->peakBuffered / 1024.0);
+}
+
+// Print run statistics as one JSON object for scripts
+void printRunStatsJSON(const RunStats* stats) {
+    printf("{\"jobs\":%d,\"succeeded\":%d,\"failed\":%d,\"retries\":%d,\"unchanged\":%d,\"duplicates\":%d,"
+           "\"resumed\":%d,\"bytes\":%zu,\"peak_buffered_bytes\":%llu,"
+           "\"seconds\":%.6f,\"pages_per_sec\":%.3f,\"bytes_per_sec\":%.1f,"
+           "\"latency_ms\":{\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f},\"phases_us\":{",
+           stats->jobs, stats->succeeded, stats->failed, stats->retries, stats->unchanged, stats->duplicates,
+           stats->resumed, stats->bytes, (unsigned long long)stats->peakBuffered,
+           stats->seconds, stats->pagesPerSecond, stats->bytesPerSecond,
+           stats->p50Ms, stats->p95Ms, stats->p99Ms);
+    
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        const PhaseStats* phase = &stats->phases[p];
+        printf("%s\"%s\":{\"count\":%d,\"mean\":%.1f,\"p50\":%u,\"p95\":%u,\"p99\":%u,\"max\":%u,\"log2_histogram\":[",
+               p > 0 ? "," : "", phaseNames[p], phase->count, phase->mean,
+               phase->p50, phase->p95, phase->p99, phase->max);
+        
+        // Trailing empty buckets are omitted
+        int last = HISTOGRAM_BUCKETS - 1;
+        while (last >= 0 && phase->histogram[last] == 0) {
+            last--;
+        }
+        for (int b = 0; b <= last; b++) {
+            printf("%s%u", b > 0 ? "," : "", phase->histogram[b]);
+        }
+        printf("]}");
+    }
+    printf("}}\n");
+}
+
+// Non-interactive mode: scrape a seed file and print stats.
+// Returns the process exit status: 0 if every page was fetched,
+// BATCH_EXIT_FAILED if any failed, 1 on other errors.
+int runBatch() {
+    int count = loadSeedFile(seedFile);
+    if (count < 0) {
+        fprintf(stderr, "Error: Could not open seed file '%s'.\n", seedFile);
+        return 1;
+    }
+    
+    RunStats stats;
+    int64_t elapsed = 0;
+    
+    if (count > 0) {
+        elapsed = runScrape();
+        if (elapsed < 0) {
+            return 1;
+        }
+    }
+    
+    computeRunStats(&stats, (uint64_t)elapsed);
+    printRunStatsJSON(&stats);
+    fflush(stdout);
+    
+    if (timingsFile != NULL && writeTimingRecords(timingsFile) != 0) {
+        fprintf(stderr, "Error: Could not write timings to '%s'.\n", timingsFile);
+        return 1;
+    }
+    return stats.failed > 0 ? BATCH_EXIT_FAILED : 0;
+}
+
+// Benchmark the fetch engine against a local mock server at each
+// concurrency level. Every level runs in its own child process so its peak
+// RSS can be read back with wait4. Prints one JSON object per level.
+int runBenchmark() {
+    int levels[MAX_BENCH_LEVELS];
+    int levelCount = 0;
+    const char* cursor = benchLevels;
+    
+    while (*cursor != '\0' && levelCount < MAX_BENCH_LEVELS) {
+        char* end;
+        long level = strtol(cursor, &end, 10);
+        if (end == cursor || level < 1) {
+            fprintf(stderr, "Error: bad concurrency list '%s'.\n", benchLevels);
+            return 1;
+        }
+        levels[levelCount++] = (int)level;
+        cursor = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            fprintf(stderr, "Error: bad concurrency list '%s'.\n", benchLevels);
+            return 1;
+        }
+    }
+    
+    // Bind before forking so the port is known and no connection can race
+    // the server's start
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    socklen_t addressLength = sizeof(address);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listenFd, SOMAXCONN) != 0 ||
+        getsockname(listenFd, (struct sockaddr*)&address, &addressLength) != 0) {
+        fprintf(stderr, "Error: could not start the mock server: %s\n", strerror(errno));
+        if (listenFd >= 0) {
+            close(listenFd);
+        }
+        return 1;
+    }
+    int port = ntohs(address.sin_port);
+    
+    pid_t server = fork();
+    if (server < 0) {
+        fprintf(stderr, "Error: could not start the mock server: %s\n", strerror(errno));
+        close(listenFd);
+        return 1;
+    }
+    if (server == 0) {
+        benchServe(listenFd);
+        _exit(1);
+    }
+    close(listenFd);
+    
+    fprintf(stderr, "Mock server on 127.0.0.1:%d: %.1f ms latency, %zu-%zu byte bodies, %.1f%% errors%s\n",
+            port, benchLatencyMs, benchBodyMin, benchBodyMax, benchErrorRate * 100,
+            benchChunked ? ", chunked" : "");
+    
+    int status = 0;
+    for (int i = 0; i < levelCount; i++) {
+        int pipeFds[2];
+        if (pipe(pipeFds) != 0) {
+            status = 1;
+            break;
+        }
+        
+        pid_t child = fork();
+        if (child == 0) {
+            RunStats stats;
+            close(pipeFds[0]);
+            int failed = benchLevel(levels[i], port, &stats) != 0 ||
+                         write(pipeFds[1], &stats, sizeof(stats)) != (ssize_t)sizeof(stats);
+            _exit(failed ? 1 : 0);
+        }
+        close(pipeFds[1]);
+        
+        RunStats stats;
+        struct rusage usage;
+        int childStatus = 0;
+        ssize_t got = child > 0 ? read(pipeFds[0], &stats, sizeof(stats)) : -1;
+        close(pipeFds[0]);
+        if (child < 0 || wait4(child, &childStatus, 0, &usage) < 0 || got != (ssize_t)sizeof(stats)) {
+            fprintf(stderr, "Error: benchmark run at concurrency %d failed.\n", levels[i]);
+            status = 1;
+            continue;
+        }
+        
+        printf("{\"engine\":\"%s\",\"concurrency\":%d,\"requests\":%d,\"succeeded\":%d,\"failed\":%d,"
+               "\"seconds\":%.6f,\"req_per_sec\":%.1f,\"mb_per_sec\":%.2f,\"p50_ms\":%.3f,\"p99_ms\":%.3f,"
+               "\"peak_rss_kb\":%ld}\n",
+               engineMode == ENGINE_MULTI ? "multi" : "threads", levels[i], stats.jobs, stats.succeeded,
+               stats.failed, stats.seconds, stats.pagesPerSecond, stats.bytesPerSecond / (1024.0 * 1024.0),
+               stats.p50Ms, stats.p99Ms, usage.ru_maxrss);
+        fflush(stdout);
+    }
+    
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    return status;
+}
+
+// One benchmark level, run in a fresh child process: scrape benchRequests
+// URLs from the mock server with the given number of transfers in flight
+int benchLevel(int concurrency, int port, RunStats* stats) {
+    // Measure the engine, not the politeness or recovery policies
+    batchMode = 1;
+    maxPerHost = 0;
+    hostRate = 0.0;
+    robotsMode = 0;
+    maxRetries = 0;
+    cacheEnabled = 0;
+    crawlDepth = 0;
+    checkpointMode = 0;
+    progressMode = 0;
+    if (engineMode == ENGINE_MULTI) {
+        maxInFlight = concurrency;
+    } else {
+        workerCount = concurrency > MAX_WORKERS ? MAX_WORKERS : concurrency;
+    }
+    
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    initializeShare();
+    dnsStart();
+    initializeSystem();
+    
+    // Bodies go to a scratch directory so the mock pages never land on top
+    // of a real crawl's output
+    char scratch[] = BENCH_DIR_TEMPLATE;
+    if (mkdtemp(scratch) == NULL || strlen(scratch) >= sizeof(outputDir)) {
+        fprintf(stderr, "Error: could not create a benchmark directory: %s\n", strerror(errno));
+        return -1;
+    }
+    strcpy(outputDir, scratch);
+    
+    int status = 0;
+    char url[MAX_URL_LENGTH];
+    for (int i = 0; i < benchRequests && status == 0; i++) {
+        int length = snprintf(url, sizeof(url), "http://127.0.0.1:%d/page/%d", port, i);
+        if (jobAppend(url, (size_t)length) < 0) {
+            status = -1;
+        }
+    }
+    
+    int64_t elapsed = status == 0 ? runScrape() : -1;
+    if (elapsed < 0) {
+        status = -1;
+    } else {
+        computeRunStats(stats, (uint64_t)elapsed);
+    }
+    
+    benchRemoveTree(scratch);
+    return status;
+}
+
+// Empty and remove the benchmark's scratch directory
+void benchRemoveTree(const char* path) {
+    DIR* directory = opendir(path);
+    struct dirent* entry;
+    char child[MAX_PATH_LENGTH];
+    
+    while (directory != NULL && (entry = readdir(directory)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (entry->d_type == DT_DIR) {
+            benchRemoveTree(child);
+        } else {
+            unlink(child);
+        }
+    }
+    if (directory != NULL) {
+        closedir(directory);
+    }
+    rmdir(path);
+}
+
+// Mock HTTP/1.1 server loop (runs in its own process until killed).
+// Single-threaded on epoll with keep-alive. Each request is answered after
+// benchLatencyMs; with a fixed latency, due times arrive in request order,
+// so a FIFO ring doubles as the timer queue.
+void benchServe(int listenFd) {
+    int epollFd = epoll_create1(0);
+    BenchConnection** connections = (BenchConnection**)calloc(BENCH_MAX_FDS, sizeof(BenchConnection*));
+    int* ring = (int*)malloc(BENCH_MAX_FDS * sizeof(int));
+    int ringHead = 0;
+    int ringCount = 0;
+    struct epoll_event events[MAX_EVENTS];
+    uint64_t latency = (uint64_t)(benchLatencyMs * 1e6);
+    
+    benchBody = (char*)malloc(benchBodyMax > 0 ? benchBodyMax : 1);
+    if (epollFd < 0 || connections == NULL || ring == NULL || benchBody == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < benchBodyMax; i++) {
+        benchBody[i] = "abcdefghijklmnopqrstuvwxyz\n"[i % 27];
+    }
+    
+    fcntl(listenFd, F_SETFL, O_NONBLOCK);
+    struct epoll_event listenEvent = {.events = EPOLLIN, .data.fd = listenFd};
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent);
+    
+    while (1) {
+        int timeoutMs = -1;
+        if (ringCount > 0) {
+            uint64_t due = connections[ring[ringHead]]->dueTime;
+            uint64_t now = monotonicNanos();
+            timeoutMs = due > now ? (int)((due - now + 999999) / 1000000) : 0;
+        }
+        
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, timeoutMs);
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            
+            if (fd == listenFd) {
+                int client;
+                while ((client = accept(listenFd, NULL, NULL)) >= 0) {
+                    if (client >= BENCH_MAX_FDS) {
+                        close(client);
+                        continue;
+                    }
+                    fcntl(client, F_SETFL, O_NONBLOCK);
+                    int one = 1;
+                    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    if (connections[client] == NULL) {
+                        connections[client] = (BenchConnection*)calloc(1, sizeof(BenchConnection));
+                    }
+                    BenchConnection* connection = connections[client];
+                    if (connection == NULL) {
+                        close(client);
+                        continue;
+                    }
+                    connection->requestLength = 0;
+                    connection->response.size = 0;
+                    connection->sent = 0;
+                    connection->waiting = 0;
+                    connection->closed = 0;
+                    struct epoll_event clientEvent = {.events = EPOLLIN, .data.fd = client};
+                    epoll_ctl(epollFd, EPOLL_CTL_ADD, client, &clientEvent);
+                }
+                continue;
+            }
+            
+            BenchConnection* connection = connections[fd];
+            if (connection->waiting) {
+                // Only hangups are reported while a response is pending
+                connection->closed = 1;
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+                continue;
+            }
+            
+            if (events[i].events & EPOLLOUT) {
+                if (benchSend(epollFd, fd, connection) < 0) {
+                    close(fd);
+                }
+                continue;
+            }
+            
+            ssize_t n = read(fd, connection->request + connection->requestLength,
+                             sizeof(connection->request) - 1 - connection->requestLength);
+            if (n <= 0) {
+                if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    close(fd);
+                }
+                continue;
+            }
+            connection->requestLength += n;
+            connection->request[connection->requestLength] = '\0';
+            
+            if (strstr(connection->request, "\r\n\r\n") != NULL) {
+                // Park the connection until its response is due
+                connection->waiting = 1;
+                connection->dueTime = monotonicNanos() + latency;
+                ring[(ringHead + ringCount) % BENCH_MAX_FDS] = fd;
+                ringCount++;
+                struct epoll_event idleEvent = {.events = 0, .data.fd = fd};
+                epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &idleEvent);
+            } else if (connection->requestLength == sizeof(connection->request) - 1) {
+                close(fd);
+            }
+        }
+        
+        uint64_t now = monotonicNanos();
+        while (ringCount > 0 && connections[ring[ringHead]]->dueTime <= now) {
+            int fd = ring[ringHead];
+            BenchConnection* connection = connections[fd];
+            ringHead = (ringHead + 1) % BENCH_MAX_FDS;
+            ringCount--;
+            connection->waiting = 0;
+            
+            if (connection->closed) {
+                close(fd);
+                continue;
+            }
+            if (benchRespond(connection) != 0 || benchSend(epollFd, fd, connection) < 0) {
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+                close(fd);
+            }
+        }
+    }
+}
+
+// Build the response to a connection's request. The path picks the body
+// size and whether it fails, so every run sees the same mix.
+int benchRespond(BenchConnection* connection) {
+    char header[256];
+    const char* path = connection->request + 4;
+    size_t pathLength = strcspn(path, " \r\n");
+    uint64_t key = mix64(hashBytes(FNV_OFFSET, path, pathLength));
+    
+    int error = (double)(key >> 11) / (double)(1ULL << 53) < benchErrorRate;
+    size_t size = error ? 0 : benchBodyMin + (benchBodyMax > benchBodyMin ?
+                                              (size_t)(mix64(key) % (benchBodyMax - benchBodyMin + 1)) : 0);
+    
+    connection->response.size = 0;
+    connection->sent = 0;
+    connection->requestLength = 0;
+    
+    int length = snprintf(header, sizeof(header),
+                          "HTTP/1.1 %s\r\nContent-Type: text/html\r\nConnection: keep-alive\r\n",
+                          error ? "500 Internal Server Error" : "200 OK");
+    if (benchChunked && !error) {
+        length += snprintf(header + length, sizeof(header) - length, "Transfer-Encoding: chunked\r\n\r\n");
+    } else {
+        length += snprintf(header + length, sizeof(header) - length, "Content-Length: %zu\r\n\r\n", size);
+    }
+    if (writeCallback(header, 1, length, &connection->response) != (size_t)length) {
+        return -1;
+    }
+    
+    if (!benchChunked || error) {
+        return writeCallback(benchBody, 1, size, &connection->response) == size ? 0 : -1;
+    }
+    
+    for (size_t offset = 0; offset < size; offset += BENCH_CHUNK_SIZE) {
+        size_t chunk = size - offset < BENCH_CHUNK_SIZE ? size - offset : BENCH_CHUNK_SIZE;
+        length = snprintf(header, sizeof(header), "%zx\r\n", chunk);
+        if (writeCallback(header, 1, length, &connection->response) != (size_t)length ||
+            writeCallback(benchBody + offset, 1, chunk, &connection->response) != chunk ||
+            writeCallback("\r\n", 1, 2, &connection->response) != 2) {
+            return -1;
+        }
+    }
+    return writeCallback("0\r\n\r\n", 1, 5, &connection->response) == 5 ? 0 : -1;
+}
+
+// Send as much of a pending response as the socket takes, then wait for
+// either more room or the next request. Returns -1 if the peer is gone.
+int benchSend(int epollFd, int fd, BenchConnection* connection) {
+    while (connection->sent < connection->response.size) {
+        ssize_t n = send(fd, connection->response.data + connection->sent,
+                         connection->response.size - connection->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return -1;
+            }
+            struct epoll_event event = {.events = EPOLLOUT, .data.fd = fd};
+            return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) == 0 ? 0 : -1;
+        }
+        connection->sent += n;
+    }
+    
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = fd};
+    return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) == 0 ? 0 : -1;
+}
+
+// Nearest-rank percentile of a sorted array
+double percentile(const uint64_t* sorted, int count, double fraction) {
+    if (count == 0) {
+        return 0;
+    }
+    int rank = (int)(fraction * count + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > count) {
+        rank = count;
+    }
+    return (double)sorted[rank - 1];
+}
+
+// qsort comparator for uint64_t values
+int compareUint64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Per-job progress messages. Batch mode keeps stdout for the stats, so
+// messages go to stderr there.
+void jobLog(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(batchMode ? stderr : stdout, format, args);
+    va_end(args);
+}
+
+// Per-job messages from workers, only printed with --verbose. Normally the
+// progress reporter stands in for them, keeping stdio off the fetch path.
+void workerLog(const char* format, ...) {
+    if (!verboseMode) {
+        return;
+    }
+    
+    va_list args;
+    va_start(args, format);
+    vfprintf(batchMode ? stderr : stdout, format, args);
+    va_end(args);
+}
+
+// Count a job handed to a worker
+void progressJobStarted(ThreadData* data) {
+    __atomic_fetch_add(&workerCounters[data->workerID].started, 1, __ATOMIC_RELAXED);
+}
+
+// Count the outcome of a job a worker just finished with. Only that worker
+// writes its slot, so the atomics never contend.
+void progressJobFinished(ThreadData* data, uint64_t retryDelay) {
+    WorkerCounters* counters = &workerCounters[data->workerID];
+    
+    if (retryDelay > 0) {
+        __atomic_fetch_add(&counters->retried, 1, __ATOMIC_RELAXED);
+    } else if (data->success) {
+        __atomic_fetch_add(&counters->succeeded, 1, __ATOMIC_RELAXED);
+        if (!data->notModified) {
+            __atomic_fetch_add(&counters->bytes, data->dataSize, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_fetch_add(&counters->failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Add up every worker's counters
+void progressSample(WorkerCounters* total) {
+    memset(total, 0, sizeof(WorkerCounters));
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        total->started += __atomic_load_n(&workerCounters[i].started, __ATOMIC_RELAXED);
+        total->succeeded += __atomic_load_n(&workerCounters[i].succeeded, __ATOMIC_RELAXED);
+        total->failed += __atomic_load_n(&workerCounters[i].failed, __ATOMIC_RELAXED);
+        total->retried += __atomic_load_n(&workerCounters[i].retried, __ATOMIC_RELAXED);
+        total->bytes += __atomic_load_n(&workerCounters[i].bytes, __ATOMIC_RELAXED);
+    }
+}
+
+// Zero the counters and start the reporter thread for a run. The live line
+// is only drawn on a terminal; the metrics file is written either way.
+void progressStart() {
+    memset(workerCounters, 0, sizeof(workerCounters));
+    memset(&reporter, 0, sizeof(reporter));
+    reporter.showLine = progressMode && !verboseMode && isatty(STDERR_FILENO);
+    
+    if (!reporter.showLine && metricsFile == NULL) {
+        return;
+    }
+    
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&reporter.lock, NULL);
+    pthread_cond_init(&reporter.wake, &attr);
+    pthread_condattr_destroy(&attr);
+    
+    reporter.startTime = monotonicNanos();
+    reporter.running = pthread_create(&reporter.thread, NULL, progressMain, NULL) == 0;
+    if (!reporter.running) {
+        pthread_mutex_destroy(&reporter.lock);
+        pthread_cond_destroy(&reporter.wake);
+    }
+}
+
+// Stop the reporter after a final update
+void progressStop() {
+    if (!reporter.running) {
+        return;
+    }
+    
+    pthread_mutex_lock(&reporter.lock);
+    reporter.stopping = 1;
+    pthread_cond_signal(&reporter.wake);
+    pthread_mutex_unlock(&reporter.lock);
+    
+    pthread_join(reporter.thread, NULL);
+    pthread_mutex_destroy(&reporter.lock);
+    pthread_cond_destroy(&reporter.wake);
+    reporter.running = 0;
+}
+
+// Reporter thread: the only place that formats progress output while
+// workers run, so console and file I/O never sit on the fetch path
+void* progressMain(void* arg) {
+    (void)arg;
+    WorkerCounters last;
+    uint64_t lastTime = reporter.startTime;
+    memset(&last, 0, sizeof(last));
+    
+    pthread_mutex_lock(&reporter.lock);
+    int stopping = 0;
+    while (!stopping) {
+        uint64_t wakeTime = monotonicNanos() + (uint64_t)PROGRESS_INTERVAL_MS * 1000000ULL;
+        struct timespec deadline;
+        deadline.tv_sec = (time_t)(wakeTime / 1000000000ULL);
+        deadline.tv_nsec = (long)(wakeTime % 1000000000ULL);
+        int waitResult = 0;
+        while (!reporter.stopping && waitResult != ETIMEDOUT) {
+            waitResult = pthread_cond_timedwait(&reporter.wake, &reporter.lock, &deadline);
+        }
+        stopping = reporter.stopping;
+        pthread_mutex_unlock(&reporter.lock);
+        
+        WorkerCounters now;
+        progressSample(&now);
+        uint64_t time = monotonicNanos();
+        double seconds = time > lastTime ? (time - lastTime) / 1e9 : 1e-9;
+        
+        if (reporter.showLine) {
+            uint64_t done = now.succeeded + now.failed;
+            uint64_t inFlight = now.started - done - now.retried;
+            double megabytesPerSecond = (now.bytes - last.bytes) / seconds / (1024.0 * 1024.0);
+            double requestsPerSecond = (done - last.succeeded - last.failed) / seconds;
+            
+            fprintf(stderr, "\r%llu/%d done, %llu failed, %llu in flight, %.2f MB/s, %.1f req/s   %s",
+                    (unsigned long long)done, __atomic_load_n(&urlCount, __ATOMIC_RELAXED),
+                    (unsigned long long)now.failed, (unsigned long long)inFlight,
+                    megabytesPerSecond, requestsPerSecond, stopping ? "\n" : "");
+        }
+        // Warn once, on the final write
+        if (metricsFile != NULL && writeMetrics(metricsFile, &now, time) != 0 && stopping) {
+            fprintf(stderr, "Warning: could not write metrics to '%s'.\n", metricsFile);
+        }
+        
+        last = now;
+        lastTime = time;
+        pthread_mutex_lock(&reporter.lock);
+    }
+    pthread_mutex_unlock(&reporter.lock);
+    
+    return NULL;
+}
+
+// Write the counters in the Prometheus text format, replacing the file
+// only once the new copy is complete
+int writeMetrics(const char* path, const WorkerCounters* total, uint64_t now) {
+    char tempPath[MAX_PATH_LENGTH + 8];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+    
+    FILE* file = fopen(tempPath, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    
+    uint64_t done = total->succeeded + total->failed;
+    fprintf(file, "# HELP scraper_jobs Jobs known to this run, including discovered links.\n");
+    fprintf(file, "# TYPE scraper_jobs gauge\n");
+    fprintf(file, "scraper_jobs %d\n", __atomic_load_n(&urlCount, __ATOMIC_RELAXED));
+    fprintf(file, "# HELP scraper_requests_total Finished requests by outcome.\n");
+    fprintf(file, "# TYPE scraper_requests_total counter\n");
+    fprintf(file, "scraper_requests_total{outcome=\"success\"} %llu\n", (unsigned long long)total->succeeded);
+    fprintf(file, "scraper_requests_total{outcome=\"failure\"} %llu\n", (unsigned long long)total->failed);
+    fprintf(file, "scraper_requests_total{outcome=\"retry\"} %llu\n", (unsigned long long)total->retried);
+    fprintf(file, "# HELP scraper_in_flight Requests currently being fetched.\n");
+    fprintf(file, "# TYPE scraper_in_flight gauge\n");
+    fprintf(file, "scraper_in_flight %llu\n", (unsigned long long)(total->started - done - total->retried));
+    fprintf(file, "# HELP scraper_bytes_total Body bytes downloaded.\n");
+    fprintf(file, "# TYPE scraper_bytes_total counter\n");
+    fprintf(file, "scraper_bytes_total %llu\n", (unsigned long long)total->bytes);
+    fprintf(file, "# HELP scraper_run_seconds Time since the run started.\n");
+    fprintf(file, "# TYPE scraper_run_seconds gauge\n");
+    fprintf(file, "scraper_run_seconds %.3f\n", (now - reporter.startTime) / 1e9);
+    
+    int failed = ferror(file) != 0;
+    if (fclose(file) != 0) {
+        failed = 1;
+    }
+    if (failed || rename(tempPath, path) != 0) {
+        unlink(tempPath);
+        return -1;
+    }
+    return 0;
+}
+
+// Parse command-line options into the global configuration
+int parseOptions(int argc, char* argv[]) {
+    int concurrency = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        int hasValue = i + 1 < argc;
+        
+        if ((strcmp(arg, "-w") == 0 || strcmp(arg, "--workers") == 0) && hasValue) {
+            workerCount = atoi(argv[++i]);
+        } else if ((strcmp(arg, "-e") == 0 || strcmp(arg, "--engine") == 0) && hasValue) {
+            const char* name = argv[++i];
+            if (strcmp(name, "threads") == 0) {
+                engineMode = ENGINE_THREADS;
+            } else if (strcmp(name, "multi") == 0) {
+                engineMode = ENGINE_MULTI;
+            } else {
+                printf("Unknown engine '%s'.\n", name);
+                return -1;
+            }
+        } else if ((strcmp(arg, "-s") == 0 || strcmp(arg, "--store") == 0) && hasValue) {
+            const char* name = argv[++i];
+            if (strcmp(name, "stream") == 0) {
+                storeMode = STORE_STREAM;
+            } else if (strcmp(name, "memory") == 0) {
+                storeMode = STORE_MEMORY;
+            } else {
+                printf("Unknown store mode '%s'.\n", name);
+                return -1;
+            }
+        } else if (strcmp(arg, "--direct") == 0) {
+            directIO = 1;
+        } else if (strcmp(arg, "--memory-budget") == 0 && hasValue) {
+            long megabytes = atol(argv[++i]);
+            memoryBudget = (uint64_t)(megabytes > 0 ? megabytes : 0) * 1024 * 1024;
+        } else if (strcmp(arg, "--max-body") == 0 && hasValue) {
+            long megabytes = atol(argv[++i]);
+            maxBodySize = (uint64_t)(megabytes > 0 ? megabytes : 0) * 1024 * 1024;
+        } else if (strcmp(arg, "--http2") == 0) {
+            http2Mode = 1;
+        } else if (strcmp(arg, "--max-streams") == 0 && hasValue) {
+            maxStreams = atoi(argv[++i]);
+            if (maxStreams < 1) {
+                maxStreams = 1;
+            }
+        } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+            seedFile = argv[++i];
+            batchMode = 1;
+        } else if ((strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) && hasValue) {
+            const char* dir = argv[++i];
+            if (strlen(dir) == 0 || strlen(dir) >= sizeof(outputDir)) {
+                printf("Output directory name too long.\n");
+                return -1;
+            }
+            strcpy(outputDir, dir);
+        } else if (strcmp(arg, "--timings") == 0 && hasValue) {
+            timingsFile = argv[++i];
+        } else if (strcmp(arg, "--per-host") == 0 && hasValue) {
+            maxPerHost = atoi(argv[++i]);
+        } else if (strcmp(arg, "--host-rate") == 0 && hasValue) {
+            hostRate = atof(argv[++i]);
+        } else if (strcmp(arg, "--host-burst") == 0 && hasValue) {
+            hostBurst = atof(argv[++i]);
+        } else if (strcmp(arg, "--robots") == 0) {
+            robotsMode = 1;
+        } else if (strcmp(arg, "--compress") == 0 && hasValue) {
+            const char* name = argv[++i];
+            if (strcmp(name, "none") == 0) {
+                compressMode = COMPRESS_NONE;
+            } else if (strcmp(name, "zstd") == 0) {
+#ifdef HAVE_ZSTD
+                compressMode = COMPRESS_ZSTD;
+#else
+                printf("This build has no zstd support (compile with -DHAVE_ZSTD -lzstd).\n");
+                return -1;
+#endif
+            } else {
+                printf("Unknown compression '%s'.\n", name);
+                return -1;
+            }
+        } else if (strcmp(arg, "--zstd-level") == 0 && hasValue) {
+            zstdLevel = atoi(argv[++i]);
+        } else if (strcmp(arg, "--zstd-dict") == 0 && hasValue) {
+            zstdDictFile = argv[++i];
+        } else if (strcmp(arg, "--archive") == 0) {
+            archiveMode = 1;
+        } else if (strcmp(arg, "--segment-size") == 0 && hasValue) {
+            long megabytes = atol(argv[++i]);
+            segmentSize = (uint64_t)(megabytes > 0 ? megabytes : 1) * 1024 * 1024;
+        } else if (strcmp(arg, "--archive-get") == 0 && hasValue) {
+            archiveGetURL = argv[++i];
+        } else if (strcmp(arg, "--depth") == 0 && hasValue) {
+            crawlDepth = atoi(argv[++i]);
+        } else if (strcmp(arg, "--same-host") == 0) {
+            sameHostOnly = 1;
+        } else if (strcmp(arg, "--max-pages") == 0 && hasValue) {
+            maxPages = atoi(argv[++i]);
+        } else if (strcmp(arg, "--extract") == 0 && hasValue) {
+            extractFile = argv[++i];
+        } else if (strcmp(arg, "--extract-threads") == 0 && hasValue) {
+            extractThreads = atoi(argv[++i]);
+            if (extractThreads < 1) {
+                extractThreads = 1;
+            } else if (extractThreads > MAX_EXTRACT_THREADS) {
+                extractThreads = MAX_EXTRACT_THREADS;
+            }
+        } else if (strcmp(arg, "--checkpoint") == 0) {
+            checkpointMode = 1;
+        } else if (strcmp(arg, "--dns-threads") == 0 && hasValue) {
+            dnsThreads = atoi(argv[++i]);
+            if (dnsThreads < 0) {
+                dnsThreads = 0;
+            } else if (dnsThreads > MAX_DNS_THREADS) {
+                dnsThreads = MAX_DNS_THREADS;
+            }
+        } else if (strcmp(arg, "--dns-ttl") == 0 && hasValue) {
+            dnsTtl = atol(argv[++i]);
+            if (dnsTtl < 0) {
+                dnsTtl = 0;
+            }
+        } else if (strcmp(arg, "--cas") == 0) {
+            casMode = 1;
+        } else if (strcmp(arg, "--cas-hash") == 0 && hasValue) {
+            const char* name = argv[++i];
+            if (strcmp(name, "xxh64") == 0) {
+                casHash = CAS_HASH_XXH64;
+            } else if (strcmp(name, "sha256") == 0) {
+#ifdef HAVE_OPENSSL
+                casHash = CAS_HASH_SHA256;
+#else
+                printf("This build has no SHA-256 support (compile with -DHAVE_OPENSSL -lcrypto).\n");
+                return -1;
+#endif
+            } else {
+                printf("Unknown hash '%s'.\n", name);
+                return -1;
+            }
+        } else if (strcmp(arg, "--bench") == 0) {
+            benchMode = 1;
+        } else if (strcmp(arg, "--bench-levels") == 0 && hasValue) {
+            benchLevels = argv[++i];
+        } else if (strcmp(arg, "--bench-requests") == 0 && hasValue) {
+            benchRequests = atoi(argv[++i]);
+            if (benchRequests < 1) {
+                benchRequests = 1;
+            }
+        } else if (strcmp(arg, "--bench-latency") == 0 && hasValue) {
+            benchLatencyMs = atof(argv[++i]);
+            if (benchLatencyMs < 0) {
+                benchLatencyMs = 0;
+            }
+        } else if (strcmp(arg, "--bench-body") == 0 && hasValue) {
+            // SIZE or MIN-MAX, in bytes
+            char* end;
+            benchBodyMin = strtoul(argv[++i], &end, 10);
+            benchBodyMax = *end == '-' ? strtoul(end + 1, NULL, 10) : benchBodyMin;
+            if (benchBodyMax < benchBodyMin) {
+                printf("Bad body size range '%s'.\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(arg, "--bench-errors") == 0 && hasValue) {
+            benchErrorRate = atof(argv[++i]);
+        } else if (strcmp(arg, "--bench-chunked") == 0) {
+            benchChunked = 1;
+        } else if (strcmp(arg, "-v") == 0 || strcmp(arg, "--verbose") == 0) {
+            verboseMode = 1;
+        } else if (strcmp(arg, "--no-progress") == 0) {
+            progressMode = 0;
+        } else if (strcmp(arg, "--metrics") == 0 && hasValue) {
+            metricsFile = argv[++i];
+        } else if (strcmp(arg, "--no-cache") == 0) {
+            cacheEnabled = 0;
+        } else if (strcmp(arg, "--retries") == 0 && hasValue) {
+            maxRetries = atoi(argv[++i]);
+            if (maxRetries < 0) {
+                maxRetries = 0;
+            }
+        } else if (strcmp(arg, "--concurrency") == 0 && hasValue) {
+            concurrency = atoi(argv[++i]);
+        } else if (strcmp(arg, "--timeout") == 0 && hasValue) {
+            requestTimeoutMs = (long)(atof(argv[++i]) * 1000);
+        } else if (strcmp(arg, "--connect-timeout") == 0 && hasValue) {
+            connectTimeoutMs = (long)(atof(argv[++i]) * 1000);
+        } else if ((strcmp(arg, "-c") == 0 || strcmp(arg, "--max-inflight") == 0) && hasValue) {
+            maxInFlight = atoi(argv[++i]);
+            if (maxInFlight < 1) {
+                maxInFlight = 1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    
+    // Records from concurrent transfers can't interleave in a segment, so
+    // archived bodies are buffered whole. The cache tracks page files, which
+    // archive mode doesn't write.
+    if (archiveMode) {
+        // Segments are only indexed when a run completes, so pages archived
+        // before a crash couldn't be found after resuming
+        if (checkpointMode) {
+            printf("--checkpoint can't be combined with --archive.\n");
+            return -1;
+        }
+        storeMode = STORE_MEMORY;
+        cacheEnabled = 0;
+        casMode = 0;
+    }
+    
+    // Extraction parses the buffered body, and needs every page fetched
+    // rather than revalidated to write a complete set of records
+    if (extractFile != NULL) {
+        storeMode = STORE_MEMORY;
+        cacheEnabled = 0;
+    }
+    
+    // Only the event loop can multiplex transfers on one connection
+    if (http2Mode) {
+        engineMode = ENGINE_MULTI;
+    }
+    
+    // --concurrency means transfers in flight, whichever engine is used
+    if (concurrency > 0) {
+        if (engineMode == ENGINE_MULTI) {
+            maxInFlight = concurrency;
+        } else if (workerCount <= 0) {
+            workerCount = concurrency;
+        }
+    }
+    
+    if (workerCount <= 0) {
+        // One event loop is enough to keep many transfers in flight
+        workerCount = engineMode == ENGINE_MULTI ? 1 : defaultWorkerCount();
+    }
+    if (workerCount > MAX_WORKERS) {
+        workerCount = MAX_WORKERS;
+    }
+    
+    // HTTP/2 runs on a single event loop, so the stream and connection caps
+    // set on its multi handle are the real per-host limits
+    if (http2Mode && workerCount > 1) {
+        printf("--http2 uses one event loop; ignoring -w %d.\n", workerCount);
+        workerCount = 1;
+    }
+    return 0;
+}
+
+// Print command-line help
+void printUsage(const char* program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  -e, --engine threads|multi  Fetch engine (default: threads)\n");
+    printf("  -w, --workers N             Worker threads or event loops\n");
+    printf("  -c, --max-inflight N        Transfers per event loop (default: %d)\n", DEFAULT_MAX_INFLIGHT);
+    printf("  -s, --store stream|memory   Write bodies to disk as they arrive, or\n");
+    printf("                              buffer them in memory (default: stream)\n");
+    printf("      --direct                Use O_DIRECT for streamed writes\n");
+    printf("      --memory-budget MB      Bytes buffered by all transfers at once; past it no\n");
+    printf("                              new transfers start and growing ones wait,\n");
+    printf("                              0 = no limit (default: %d)\n", DEFAULT_MEMORY_BUDGET_MB);
+    printf("      --max-body MB           Fail responses larger than MB, 0 = no limit (default)\n");
+    printf("      --http2                 Multiplex each host's requests over HTTP/2 (implies\n");
+    printf("                              -e multi -w 1; hosts without h2 get pooled HTTP/1.1)\n");
+    printf("      --max-streams N         Requests per HTTP/2 connection (default: %d)\n", DEFAULT_MAX_STREAMS);
+    printf("\nPoliteness (per host):\n");
+    printf("      --per-host N            Connections per host, 0 = no cap (default: %d)\n", DEFAULT_MAX_PER_HOST);
+    printf("      --host-rate R           Requests per second per host, 0 = no limit (default)\n");
+    printf("      --host-burst B          Requests a host may receive back to back (default: %d)\n", DEFAULT_HOST_BURST);
+    printf("      --robots                Honour robots.txt Crawl-delay\n");
+    printf("\nRetries:\n");
+    printf("      --retries N             Retries for timeouts, 5xx/429 and connection\n");
+    printf("                              errors, with exponential backoff (default: %d)\n", DEFAULT_MAX_RETRIES);
+    printf("      --no-cache              Always refetch; don't read or write %s\n", CACHE_INDEX_FILE);
+    printf("\nCrawling:\n");
+    printf("      --depth N               Follow links up to N hops from the seed URLs (default: 0)\n");
+    printf("      --same-host             Only follow links to the host of the linking page\n");
+    printf("      --max-pages N           Stop adding links once N pages are known, 0 = no limit\n");
+    printf("      --checkpoint            Journal progress to %s in the output directory and\n", CHECKPOINT_JOURNAL_FILE);
+    printf("                              skip finished pages when a run is restarted\n");
+    printf("\nExtraction:\n");
+    printf("      --extract FILE          Parse each HTML page on a separate thread pool and\n");
+    printf("                              write its title, meta tags, links and text to FILE\n");
+    printf("                              as JSON lines (implies -s memory, --no-cache)\n");
+    printf("      --extract-threads N     Parser threads (default: %d)\n", DEFAULT_EXTRACT_THREADS);
+    printf("\nName resolution:\n");
+    printf("      --dns-threads N         Resolver threads that look up hosts while jobs load,\n");
+    printf("                              0 = leave it all to libcurl (default: %d)\n", DEFAULT_DNS_THREADS);
+    printf("      --dns-ttl SECS          How long resolved addresses are reused (default: %d);\n", DEFAULT_DNS_TTL);
+    printf("                              a fixed lifetime, since record TTLs aren't available\n");
+    printf("\nStorage:\n");
+    printf("      --compress zstd|none    Store pages zstd-compressed as .html.zst (default: none)\n");
+    printf("      --zstd-level N          Compression level (default: %d)\n", DEFAULT_ZSTD_LEVEL);
+    printf("      --zstd-dict FILE        Shared dictionary, e.g. from 'zstd --train pages/* -o FILE'\n");
+    printf("      --archive               Append pages to per-worker WARC segments indexed\n");
+    printf("                              by URL in %s (implies -s memory, --no-cache)\n", ARCHIVE_INDEX_FILE);
+    printf("      --segment-size MB       Start a new segment after MB megabytes (default: %d)\n", DEFAULT_SEGMENT_MB);
+    printf("      --archive-get URL       Print an archived page and exit\n");
+    printf("      --cas                   Store each distinct body once under %s/, named by\n", CAS_DIR);
+    printf("                              its hash, and list URLs in %s\n", CAS_MANIFEST_FILE);
+    printf("      --cas-hash xxh64|sha256 Object naming hash (default: %s)\n",
+           DEFAULT_CAS_HASH == CAS_HASH_SHA256 ? "sha256" : "xxh64");
+    printf("\nBatch mode:\n");
+    printf("      --seed FILE             Scrape the URLs in FILE and exit (status 2 if any\n");
+    printf("                              page failed, 1 on other errors)\n");
+    printf("  -o, --output DIR            Output directory (default: %s)\n", OUTPUT_DIR);
+    printf("      --concurrency N         Transfers in flight (workers or -c)\n");
+    printf("      --timeout SECS          Whole-request timeout (default: 30)\n");
+    printf("      --connect-timeout SECS  Connection timeout (default: curl's)\n");
+    printf("      --timings FILE          Write per-request timing records (JSONL)\n");
+    printf("\nBenchmark (local mock server, no network needed):\n");
+    printf("      --bench                 Scrape a local HTTP/1.1 server at each concurrency\n");
+    printf("                              level and print req/s, p99 and peak RSS as JSON\n");
+    printf("                              (per-host limits, robots, retries and cache off)\n");
+    printf("      --bench-levels LIST     Concurrency levels (default: %s)\n", DEFAULT_BENCH_LEVELS);
+    printf("      --bench-requests N      Requests per level (default: %d)\n", DEFAULT_BENCH_REQUESTS);
+    printf("      --bench-latency MS      Server delay before each response (default: 0)\n");
+    printf("      --bench-body N[-MAX]    Body bytes, or a range picked per URL (default: %d)\n", DEFAULT_BENCH_BODY);
+    printf("      --bench-errors F        Fraction of URLs answered with 500 (default: 0)\n");
+    printf("      --bench-chunked         Send bodies with chunked transfer encoding\n");
+    printf("\nOutput:\n");
+    printf("  -v, --verbose               Print a line per request instead of the progress line\n");
+    printf("      --no-progress           Don't draw the live progress line on a terminal\n");
+    printf("      --metrics FILE          Keep Prometheus-format counters in FILE during a run\n");
+}
+
+// Number of workers to use when none is given on the command line
+int defaultWorkerCount() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) {
+        cores = 1;
+    }
+    // Scraping is I/O bound, so oversubscribe the cores a little
+    long workers = cores * 2;
+    return workers > MAX_WORKERS ? MAX_WORKERS : (int)workers;
+}
+
+// Initialize an empty job queue
+int queueInit(JobQueue* queue) {
+    memset(queue, 0, sizeof(JobQueue));
+    queue->hostCapacity = INITIAL_HOST_TABLE / 2;
+    queue->tableSize = INITIAL_HOST_TABLE;
+    queue->hosts = (HostState*)malloc(queue->hostCapacity * sizeof(HostState));
+    queue->heap = (int*)malloc(queue->hostCapacity * sizeof(int));
+    queue->hostTable = (int*)malloc(queue->tableSize * sizeof(int));
+    if (queue->hosts == NULL || queue->heap == NULL || queue->hostTable == NULL) {
+        free(queue->hosts);
+        free(queue->heap);
+        free(queue->hostTable);
+        return -1;
+    }
+    memset(queue->hostTable, 0xff, queue->tableSize * sizeof(int));
+    
+    // Waits for rate-limited hosts are timed against the monotonic clock
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->notEmpty, &attr);
+    pthread_cond_init(&queue->robotsWake, NULL);
+    pthread_condattr_destroy(&attr);
+    return 0;
+}
+
+// Release job queue resources
+void queueDestroy(JobQueue* queue) {
+    free(queue->hosts);
+    free(queue->heap);
+    free(queue->hostTable);
+    free(queue->retries);
+    queue->retries = NULL;
+    queue->hosts = NULL;
+    queue->heap = NULL;
+    queue->hostTable = NULL;
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->notEmpty);
+    pthread_cond_destroy(&queue->robotsWake);
+}
+
+// Add a job to the tail of its host's queue (safe to call from workers)
+int queuePush(JobQueue* queue, int jobIndex) {
+    ThreadData* data = jobAt(jobIndex);
+    
+    pthread_mutex_lock(&queue->lock);
+    
+    int hostIndex = hostLookup(queue, data);
+    if (hostIndex < 0) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+    
+    data->hostIndex = hostIndex;
+    queue->pending++;
+    hostAppend(queue, jobIndex, monotonicNanos());
+    
+    pthread_cond_signal(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+// Take the next job from the next ready host; blocks while a host is being
+// rate limited, a retry is backing off, or other workers may still add work.
+// Returns 0 once the queue is empty and no job is in progress.
+int queuePop(JobQueue* queue, int* jobIndex) {
+    pthread_mutex_lock(&queue->lock);
+    
+    while (queue->count > 0 || queue->pending > 0) {
+        uint64_t now = monotonicNanos();
+        uint64_t wakeTime = UINT64_MAX;
+        
+        queueReleaseRetries(queue, now);
+        
+        if (queue->heapSize > 0) {
+            uint64_t readyTime = queue->hosts[queue->heap[0]].readyTime;
+            if (readyTime <= now) {
+                *jobIndex = queueTake(queue, now);
+                pthread_mutex_unlock(&queue->lock);
+                return 1;
+            }
+            wakeTime = readyTime;
+        }
+        if (queue->retryCount > 0 && queue->retries[0].dueTime < wakeTime) {
+            wakeTime = queue->retries[0].dueTime;
+        }
+        
+        if (wakeTime == UINT64_MAX) {
+            // Every host with work is at its connection cap
+            pthread_cond_wait(&queue->notEmpty, &queue->lock);
+            continue;
+        }
+        
+        // Sleep until a host has a token or a retry is due, or new work arrives
+        struct timespec deadline;
+        deadline.tv_sec = (time_t)(wakeTime / 1000000000ULL);
+        deadline.tv_nsec = (long)(wakeTime % 1000000000ULL);
+        pthread_cond_timedwait(&queue->notEmpty, &queue->lock, &deadline);
+    }
+    
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+// Take the next job without blocking. Returns 0 if no host is ready.
+int queueTryPop(JobQueue* queue, int* jobIndex) {
+    pthread_mutex_lock(&queue->lock);
+    
+    uint64_t now = monotonicNanos();
+    queueReleaseRetries(queue, now);
+    if (queue->heapSize == 0 || queue->hosts[queue->heap[0]].readyTime > now) {
+        pthread_mutex_unlock(&queue->lock);
+        return 0;
+    }
+    
+    *jobIndex = queueTake(queue, now);
+    
+    pthread_mutex_unlock(&queue->lock);
+    return 1;
+}
+
+// Mark a popped job as finished, freeing its host's connection slot, and
+// wake idle workers if all work is done
+void queueJobDone(JobQueue* queue, int jobIndex) {
+    pthread_mutex_lock(&queue->lock);
+    
+    int hostIndex = jobAt(jobIndex)->hostIndex;
+    HostState* host = &queue->hosts[hostIndex];
+    int wasCapped = host->heapSlot < 0 && host->queued > 0;
+    
+    if (jobAt(jobIndex)->multiplexed) {
+        host->multiplexed = 1;
+    }
+    host->active--;
+    hostUpdate(queue, hostIndex, monotonicNanos());
+    
+    queue->pending--;
+    if (queue->pending == 0) {
+        pthread_cond_broadcast(&queue->notEmpty);
+    } else if (wasCapped) {
+        pthread_cond_signal(&queue->notEmpty);
+    }
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Put a failed job back after a delay. Its host's connection slot is freed
+// now, but the job stays pending so workers keep waiting for it.
+// Returns -1 if the job could not be stored; it is then finished instead.
+int queueRetry(JobQueue* queue, int jobIndex, uint64_t delayNanos) {
+    pthread_mutex_lock(&queue->lock);
+    
+    if (queue->retryCount == queue->retryCapacity) {
+        int capacity = queue->retryCapacity ? queue->retryCapacity * 2 : INITIAL_RETRY_CAPACITY;
+        RetryEntry* retries = (RetryEntry*)realloc(queue->retries, capacity * sizeof(RetryEntry));
+        if (retries == NULL) {
+            pthread_mutex_unlock(&queue->lock);
+            queueJobDone(queue, jobIndex);
+            return -1;
+        }
+        queue->retries = retries;
+        queue->retryCapacity = capacity;
+    }
+    
+    uint64_t now = monotonicNanos();
+    RetryEntry entry = { now + delayNanos, jobIndex };
+    
+    // Sift the new entry up the due-time heap
+    int slot = queue->retryCount++;
+    while (slot > 0) {
+        int parent = (slot - 1) / 2;
+        if (queue->retries[parent].dueTime <= entry.dueTime) {
+            break;
+        }
+        queue->retries[slot] = queue->retries[parent];
+        slot = parent;
+    }
+    queue->retries[slot] = entry;
+    
+    int hostIndex = jobAt(jobIndex)->hostIndex;
+    if (jobAt(jobIndex)->multiplexed) {
+        queue->hosts[hostIndex].multiplexed = 1;
+    }
+    queue->hosts[hostIndex].active--;
+    hostUpdate(queue, hostIndex, now);
+    
+    // A waiting worker may need an earlier wake-up or now has a free host
+    pthread_cond_signal(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+// Move retries whose backoff has expired back onto their hosts' queues
+// (caller holds the queue lock)
+void queueReleaseRetries(JobQueue* queue, uint64_t now) {
+    RetryEntry* retries = queue->retries;
+    
+    while (queue->retryCount > 0 && retries[0].dueTime <= now) {
+        int jobIndex = retries[0].jobIndex;
+        
+        // Pop the root and sift the last entry down
+        RetryEntry last = retries[--queue->retryCount];
+        int slot = 0;
+        while (1) {
+            int child = slot * 2 + 1;
+            if (child >= queue->retryCount) {
+                break;
+            }
+            if (child + 1 < queue->retryCount && retries[child + 1].dueTime < retries[child].dueTime) {
+                child++;
+            }
+            if (last.dueTime <= retries[child].dueTime) {
+                break;
+            }
+            retries[slot] = retries[child];
+            slot = child;
+        }
+        if (queue->retryCount > 0) {
+            retries[slot] = last;
+        }
+        
+        hostAppend(queue, jobIndex, now);
+    }
+}
+
+// Start the head job of the host at the top of the ready heap
+// (caller holds the queue lock and has checked that the host is ready)
+int queueTake(JobQueue* queue, uint64_t now) {
+    int hostIndex = queue->heap[0];
+    HostState* host = &queue->hosts[hostIndex];
+    int jobIndex = host->head;
+    
+    host->head = jobAt(jobIndex)->nextInHost;
+    if (host->head < 0) {
+        host->tail = -1;
+    }
+    host->queued--;
+    host->active++;
+    host->lastStart = now;
+    if (host->rate > 0) {
+        host->tokens -= 1.0;
+    }
+    queue->count--;
+    
+    hostUpdate(queue, hostIndex, now);
+    return jobIndex;
+}
+
+// Link a job onto the tail of its host's queue (caller holds the queue lock
+// and has counted the job as pending)
+void hostAppend(JobQueue* queue, int jobIndex, uint64_t now) {
+    ThreadData* data = jobAt(jobIndex);
+    HostState* host = &queue->hosts[data->hostIndex];
+    
+    data->nextInHost = -1;
+    if (host->tail >= 0) {
+        jobAt(host->tail)->nextInHost = jobIndex;
+    } else {
+        host->head = jobIndex;
+    }
+    host->tail = jobIndex;
+    host->queued++;
+    queue->count++;
+    hostUpdate(queue, data->hostIndex, now);
+}
+
+// FNV-1a hash of a host name, ignoring case
+uint32_t hostHash(const char* name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint32_t)tolower((unsigned char)name[i])) * 16777619u;
+    }
+    return hash;
+}
+
+// Find or create the host entry for a job (caller holds the queue lock).
+// Returns the host index, or -1 if out of memory.
+int hostLookup(JobQueue* queue, ThreadData* data) {
+    size_t start, length, origin;
+    urlHostPart(data->url, data->urlLength, &start, &length, &origin);
+    const char* name = data->url + start;
+    
+    // Keep the table at most half full
+    if (queue->hostCount == queue->hostCapacity) {
+        int capacity = queue->hostCapacity * 2;
+        int tableSize = queue->tableSize * 2;
+        HostState* hosts = (HostState*)realloc(queue->hosts, capacity * sizeof(HostState));
+        if (hosts == NULL) {
+            return -1;
+        }
+        queue->hosts = hosts;
+        int* heap = (int*)realloc(queue->heap, capacity * sizeof(int));
+        if (heap == NULL) {
+            return -1;
+        }
+        queue->heap = heap;
+        int* table = (int*)malloc(tableSize * sizeof(int));
+        if (table == NULL) {
+            return -1;
+        }
+        memset(table, 0xff, tableSize * sizeof(int));
+        for (int i = 0; i < queue->hostCount; i++) {
+            uint32_t slot = hostHash(hosts[i].name, hosts[i].nameLength) & (tableSize - 1);
+            while (table[slot] >= 0) {
+                slot = (slot + 1) & (tableSize - 1);
+            }
+            table[slot] = i;
+        }
+        free(queue->hostTable);
+        queue->hostTable = table;
+        queue->hostCapacity = capacity;
+        queue->tableSize = tableSize;
+    }
+    
+    uint32_t mask = (uint32_t)queue->tableSize - 1;
+    uint32_t slot = hostHash(name, length) & mask;
+    while (queue->hostTable[slot] >= 0) {
+        HostState* host = &queue->hosts[queue->hostTable[slot]];
+        if (host->nameLength == length && strncasecmp(host->name, name, length) == 0) {
+            return queue->hostTable[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    
+    int index = queue->hostCount++;
+    HostState* host = &queue->hosts[index];
+    host->origin = data->url;
+    host->originLength = (uint32_t)origin;
+    host->name = name;
+    host->nameLength = (uint32_t)length;
+    host->head = -1;
+    host->tail = -1;
+    host->queued = 0;
+    host->active = 0;
+    host->rate = hostRate;
+    host->burst = hostBurst < 1.0 ? 1.0 : hostBurst;
+    host->tokens = host->burst;
+    host->refillTime = monotonicNanos();
+    host->lastStart = 0;
+    host->readyTime = 0;
+    host->heapSlot = -1;
+    host->multiplexed = 0;
+    host->robotsPending = queue->robotsGate;
+    queue->hostTable[slot] = index;
+    if (queue->robotsGate) {
+        pthread_cond_signal(&queue->robotsWake);
+    }
+    return index;
+}
+
+// Recompute when a host can next start a job and its place in the ready
+// heap (caller holds the queue lock). Ready hosts are keyed by their last
+// start time, so hosts take turns.
+void hostUpdate(JobQueue* queue, int hostIndex, uint64_t now) {
+    HostState* host = &queue->hosts[hostIndex];
+    
+    // Once a host has answered over HTTP/2, each of its connections carries
+    // up to maxStreams jobs. Until then it may be HTTP/1.1, where extra jobs
+    // would only sit in libcurl's queue with their timeouts running.
+    int hostLimit = http2Mode && host->multiplexed ? maxPerHost * maxStreams : maxPerHost;
+    if (host->queued == 0 || host->robotsPending || (hostLimit > 0 && host->active >= hostLimit)) {
+        if (host->heapSlot >= 0) {
+            heapRemove(queue, host->heapSlot);
+        }
+        return;
+    }
+    
+    uint64_t readyTime = host->lastStart;
+    if (host->rate > 0) {
+        // Refill the token bucket for the time since the last update
+        if (now > host->refillTime) {
+            host->tokens += (double)(now - host->refillTime) * host->rate / 1e9;
+            host->refillTime = now;
+        }
+        if (host->tokens > host->burst) {
+            host->tokens = host->burst;
+        }
+        if (host->tokens < 1.0) {
+            uint64_t tokenTime = now + (uint64_t)((1.0 - host->tokens) / host->rate * 1e9);
+            if (tokenTime > readyTime) {
+                readyTime = tokenTime;
+            }
+        }
+    }
+    host->readyTime = readyTime;
+    
+    if (host->heapSlot < 0) {
+        host->heapSlot = queue->heapSize;
+        queue->heap[queue->heapSize++] = hostIndex;
+        heapSiftUp(queue, host->heapSlot);
+    } else {
+        heapSiftUp(queue, host->heapSlot);
+        heapSiftDown(queue, host->heapSlot);
+    }
+}
+
+// Limit a host to one request per Crawl-delay, if that is stricter than the
+// configured rate
+void hostSetCrawlDelay(HostState* host, double seconds) {
+    if (seconds <= 0) {
+        return;
+    }
+    
+    double rate = 1.0 / seconds;
+    if (host->rate <= 0 || rate < host->rate) {
+        host->rate = rate;
+    }
+    host->burst = 1.0;
+    if (host->tokens > 1.0) {
+        host->tokens = 1.0;
+    }
+}
+
+// Move a heap entry towards the root while it is due sooner than its parent
+void heapSiftUp(JobQueue* queue, int slot) {
+    int* heap = queue->heap;
+    HostState* hosts = queue->hosts;
+    int item = heap[slot];
+    
+    while (slot > 0) {
+        int parent = (slot - 1) / 2;
+        if (hosts[heap[parent]].readyTime <= hosts[item].readyTime) {
+            break;
+        }
+        heap[slot] = heap[parent];
+        hosts[heap[slot]].heapSlot = slot;
+        slot = parent;
+    }
+    heap[slot] = item;
+    hosts[item].heapSlot = slot;
+}
+
+// Move a heap entry towards the leaves while a child is due sooner
+void heapSiftDown(JobQueue* queue, int slot) {
+    int* heap = queue->heap;
+    HostState* hosts = queue->hosts;
+    int item = heap[slot];
+    
+    while (1) {
+        int child = slot * 2 + 1;
+        if (child >= queue->heapSize) {
+            break;
+        }
+        if (child + 1 < queue->heapSize && hosts[heap[child + 1]].readyTime < hosts[heap[child]].readyTime) {
+            child++;
+        }
+        if (hosts[item].readyTime <= hosts[heap[child]].readyTime) {
+            break;
+        }
+        heap[slot] = heap[child];
+        hosts[heap[slot]].heapSlot = slot;
+        slot = child;
+    }
+    heap[slot] = item;
+    hosts[item].heapSlot = slot;
+}
+
+// Take a host out of the ready heap
+void heapRemove(JobQueue* queue, int slot) {
+    int* heap = queue->heap;
+    HostState* hosts = queue->hosts;
+    
+    hosts[heap[slot]].heapSlot = -1;
+    queue->heapSize--;
+    if (slot < queue->heapSize) {
+        int moved = heap[queue->heapSize];
+        heap[slot] = moved;
+        hosts[moved].heapSlot = slot;
+        heapSiftUp(queue, slot);
+        heapSiftDown(queue, hosts[moved].heapSlot);
+    }
+}
+
+// Locate the host in a URL, along with the length of its scheme://authority
+// prefix. URLs without a scheme are treated as starting with the authority.
+void urlHostPart(const char* url, size_t length, size_t* hostStart, size_t* hostLength, size_t* originLength) {
+    size_t start = 0;
+    
+    for (size_t i = 0; i < length; i++) {
+        if (url[i] == '/' || url[i] == '?' || url[i] == '#') {
+            break;
+        }
+        if (url[i] == ':' && i + 2 < length && url[i + 1] == '/' && url[i + 2] == '/') {
+            start = i + 3;
+            break;
+        }
+    }
+    
+    size_t end = start;
+    while (end < length && url[end] != '/' && url[end] != '?' && url[end] != '#') {
+        end++;
+    }
+    
+    // Skip any user:password@ prefix, and stop before the port
+    size_t host = start;
+    for (size_t i = start; i < end; i++) {
+        if (url[i] == '@') {
+            host = i + 1;
+        }
+    }
+    size_t hostEnd = host;
+    if (hostEnd < end && url[hostEnd] == '[') {
+        while (hostEnd < end && url[hostEnd] != ']') {
+            hostEnd++;
+        }
+        if (hostEnd < end) {
+            hostEnd++;
+        }
+    } else {
+        while (hostEnd < end && url[hostEnd] != ':') {
+            hostEnd++;
+        }
+    }
+    
+    *hostStart = host;
+    *hostLength = hostEnd - host;
+    *originLength = end;
+}
+
+// Start the thread that fetches robots.txt for each host as it enters the
+// host table, seeds and crawled hosts alike. A host's jobs are held back
+// until its Crawl-delay is known, while other hosts are already fetched.
+// Returns 0 on success; on failure no host is held back.
+int robotsStart(JobQueue* queue, pthread_t* thread) {
+    if (pthread_create(thread, NULL, robotsMain, queue) == 0) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&queue->lock);
+    queue->robotsGate = 0;
+    uint64_t now = monotonicNanos();
+    for (int i = 0; i < queue->hostCount; i++) {
+        queue->hosts[i].robotsPending = 0;
+        hostUpdate(queue, i, now);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return -1;
+}
+
+// Stop the robots.txt thread once the pool has drained the queue
+void robotsStop(JobQueue* queue, pthread_t thread) {
+    pthread_mutex_lock(&queue->lock);
+    queue->robotsStopping = 1;
+    pthread_cond_signal(&queue->robotsWake);
+    pthread_mutex_unlock(&queue->lock);
+    
+    pthread_join(thread, NULL);
+    jobLog("robots.txt: Crawl-delay applied to %d of %d host(s)\n", queue->robotsApplied, queue->hostCount);
+}
+
+// Let a host's jobs run, with its Crawl-delay if robots.txt gave one
+// (caller holds the queue lock)
+void robotsRelease(JobQueue* queue, int hostIndex, double delay) {
+    HostState* host = &queue->hosts[hostIndex];
+    
+    if (delay > 0) {
+        hostSetCrawlDelay(host, delay);
+        queue->robotsApplied++;
+    }
+    host->robotsPending = 0;
+    hostUpdate(queue, hostIndex, monotonicNanos());
+    pthread_cond_broadcast(&queue->notEmpty);
+}
+
+// robots.txt thread: fetch each new host's robots.txt, up to maxInFlight
+// at a time, until robotsStop
+void* robotsMain(void* arg) {
+    JobQueue* queue = (JobQueue*)arg;
+    CURLM* multi = curl_multi_init();
+    int active = 0;
+    
+    while (1) {
+        char url[MAX_URL_LENGTH];
+        int hostIndex = -1;
+        
+        pthread_mutex_lock(&queue->lock);
+        while (active == 0 && queue->robotsNext == queue->hostCount && !queue->robotsStopping) {
+            pthread_cond_wait(&queue->robotsWake, &queue->lock);
+        }
+        if (queue->robotsStopping && active == 0) {
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        
+        // Take the next new host; only http(s) origins have a robots.txt
+        if (active < maxInFlight && queue->robotsNext < queue->hostCount) {
+            hostIndex = queue->robotsNext++;
+            HostState* host = &queue->hosts[hostIndex];
+            if (multi == NULL || strncasecmp(host->origin, "http", 4) != 0 ||
+                host->originLength + sizeof("/robots.txt") > sizeof(url)) {
+                robotsRelease(queue, hostIndex, 0);
+                hostIndex = -1;
+            } else {
+                snprintf(url, sizeof(url), "%.*s/robots.txt", (int)host->originLength, host->origin);
+            }
+        }
+        int more = queue->robotsNext < queue->hostCount;
+        pthread_mutex_unlock(&queue->lock);
+        
+        if (hostIndex >= 0) {
+            RobotsFetch* fetch = (RobotsFetch*)calloc(1, sizeof(RobotsFetch));
+            CURL* curl = fetch != NULL ? curl_easy_init() : NULL;
+            
+            if (curl != NULL) {
+                fetch->hostIndex = hostIndex;
+                curl_easy_setopt(curl, CURLOPT_URL, url);
+                curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
+                curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&fetch->body);
+                curl_easy_setopt(curl, CURLOPT_MAXFILESIZE_LARGE, (curl_off_t)MAX_ROBOTS_SIZE);
+                curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+                curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, requestTimeoutMs);
+                if (connectTimeoutMs > 0) {
+                    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, connectTimeoutMs);
+                }
+                curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0 (Web Scraper/1.0)");
+                curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+                curl_easy_setopt(curl, CURLOPT_PRIVATE, (void*)fetch);
+                if (shareHandle != NULL) {
+                    curl_easy_setopt(curl, CURLOPT_SHARE, shareHandle);
+                }
+            }
+            
+            if (curl != NULL && curl_multi_add_handle(multi, curl) == CURLM_OK) {
+                active++;
+            } else {
+                if (curl != NULL) {
+                    curl_easy_cleanup(curl);
+                }
+                free(fetch);
+                pthread_mutex_lock(&queue->lock);
+                robotsRelease(queue, hostIndex, 0);
+                pthread_mutex_unlock(&queue->lock);
+            }
+        }
+        
+        // Start every waiting host before running the transfers
+        if ((more && active < maxInFlight) || active == 0) {
+            continue;
+        }
+        
+        int running;
+        curl_multi_perform(multi, &running);
+        
+        CURLMsg* message;
+        int remaining;
+        while ((message = curl_multi_info_read(multi, &remaining)) != NULL) {
+            if (message->msg != CURLMSG_DONE) {
+                continue;
+            }
+            
+            CURL* curl = message->easy_handle;
+            char* priv = NULL;
+            long status = 0;
+            double delay = 0;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, &priv);
+            RobotsFetch* fetch = (RobotsFetch*)priv;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+            
+            if (message->data.result == CURLE_OK && status == 200 && fetch->body.data != NULL) {
+                delay = parseCrawlDelay(fetch->body.data, fetch->body.size);
+            }
+            pthread_mutex_lock(&queue->lock);
+            robotsRelease(queue, fetch->hostIndex, delay);
+            pthread_mutex_unlock(&queue->lock);
+            
+            curl_multi_remove_handle(multi, curl);
+            curl_easy_cleanup(curl);
+            free(fetch->body.data);
+            free(fetch);
+            active--;
+        }
+        
+        // Capped so hosts found meanwhile are picked up promptly
+        if (active > 0) {
+            curl_multi_poll(multi, NULL, 0, MAX_LOOP_WAIT_MS, NULL);
+        }
+    }
+    
+    // Stopping waits for the last fetches, so no handle is left here
+    if (multi != NULL) {
+        curl_multi_cleanup(multi);
+    }
+    return NULL;
+}
+
+// Crawl-delay in seconds from the "User-agent: *" group of a robots.txt,
+// or 0 if there is none
+double parseCrawlDelay(const char* text, size_t length) {
+    size_t pos = 0;
+    int inGroup = 0;
+    int groupHasRules = 0;
+    double delay = 0;
+    
+    while (pos < length) {
+        size_t end = pos;
+        while (end < length && text[end] != '\n') {
+            end++;
+        }
+        
+        // Split "field: value # comment" into trimmed field and value
+        size_t lineEnd = pos;
+        while (lineEnd < end && text[lineEnd] != '#') {
+            lineEnd++;
+        }
+        size_t colon = pos;
+        while (colon < lineEnd && text[colon] != ':') {
+            colon++;
+        }
+        
+        if (colon < lineEnd) {
+            size_t fieldStart = pos;
+            size_t fieldEnd = colon;
+            size_t valueStart = colon + 1;
+            size_t valueEnd = lineEnd;
+            while (fieldStart < fieldEnd && isspace((unsigned char)text[fieldStart])) {
+                fieldStart++;
+            }
+            while (fieldEnd > fieldStart && isspace((unsigned char)text[fieldEnd - 1])) {
+                fieldEnd--;
+            }
+            while (valueStart < valueEnd && isspace((unsigned char)text[valueStart])) {
+                valueStart++;
+            }
+            while (valueEnd > valueStart && isspace((unsigned char)text[valueEnd - 1])) {
+                valueEnd--;
+            }
+            
+            const char* field = text + fieldStart;
+            size_t fieldLength = fieldEnd - fieldStart;
+            char value[32];
+            size_t valueLength = valueEnd - valueStart;
+            if (valueLength >= sizeof(value)) {
+                valueLength = sizeof(value) - 1;
+            }
+            memcpy(value, text + valueStart, valueLength);
+            value[valueLength] = '\0';
+            
+            if (fieldLength == 10 && strncasecmp(field, "user-agent", 10) == 0) {
+                // Consecutive User-agent lines open one group
+                if (groupHasRules) {
+                    inGroup = 0;
+                    groupHasRules = 0;
+                }
+                if (strcmp(value, "*") == 0) {
+                    inGroup = 1;
+                }
+            } else {
+                groupHasRules = 1;
+                if (inGroup && fieldLength == 11 && strncasecmp(field, "crawl-delay", 11) == 0) {
+                    delay = strtod(value, NULL);
+                }
+            }
+        }
+        
+        pos = end + 1;
+    }
+    
+    return delay > 0 ? delay : 0;
+}
+
+// Add a newly found URL and queue it for the running pool.
+// Returns the job index, or -1 if it could not be stored.
+int enqueueURL(const char* url) {
+    int index = jobAppend(url, strlen(url));
+    
+    if (index >= 0 && activeQueue != NULL) {
+        queuePush(activeQueue, index);
+    }
+    return index;
+}
+
+// Start a link scanner for a transfer; it stays idle until the first body
+// bytes show whether the page is HTML worth following
+void linkScanInit(LinkScanner* scanner, ThreadData* data) {
+    scanner->state = crawlDepth > data->depth ? LINK_SCAN_PENDING : LINK_SCAN_OFF;
+    scanner->match = 0;
+    scanner->quote = 0;
+    scanner->afterSpace = 0;
+    scanner->afterEquals = 0;
+    scanner->valueLength = 0;
+    scanner->overflow = 0;
+    scanner->base = NULL;
+    scanner->host = NULL;
+}
+
+// Release a link scanner's base URL
+void linkScanFree(LinkScanner* scanner) {
+    curl_url_cleanup(scanner->base);
+    curl_free(scanner->host);
+    scanner->base = NULL;
+    scanner->host = NULL;
+    scanner->state = LINK_SCAN_OFF;
+}
+
+// Feed body bytes to the link scanner as they arrive. A small state machine
+// picks href attribute values out of tags, carrying its state across chunk
+// boundaries, so links are found without a second pass over the page.
+// Other attributes' quoted values are skipped whole, so a '>' or "href"
+// inside one doesn't end the tag or start a link.
+void linkScan(Transfer* transfer, const char* input, size_t length) {
+    LinkScanner* scanner = &transfer->links;
+    
+    if (scanner->state == LINK_SCAN_PENDING) {
+        // Only follow successful HTML responses, resolved against the URL
+        // the body actually came from
+        long status = 0;
+        char* contentType = NULL;
+        char* effective = NULL;
+        curl_easy_getinfo(transfer->curl, CURLINFO_RESPONSE_CODE, &status);
+        curl_easy_getinfo(transfer->curl, CURLINFO_CONTENT_TYPE, &contentType);
+        curl_easy_getinfo(transfer->curl, CURLINFO_EFFECTIVE_URL, &effective);
+        
+        scanner->state = LINK_SCAN_OFF;
+        if (status < 200 || status >= 300 || effective == NULL || !htmlContentType(contentType)) {
+            return;
+        }
+        scanner->base = curl_url();
+        if (scanner->base == NULL || curl_url_set(scanner->base, CURLUPART_URL, effective, 0) != CURLUE_OK ||
+            curl_url_get(scanner->base, CURLUPART_HOST, &scanner->host, 0) != CURLUE_OK) {
+            linkScanFree(scanner);
+            return;
+        }
+        scanner->state = LINK_SCAN_TEXT;
+    }
+    
+    for (size_t i = 0; i < length && scanner->state != LINK_SCAN_OFF; i++) {
+        char c = input[i];
+        
+        switch (scanner->state) {
+            case LINK_SCAN_TEXT:
+                if (c == '<') {
+                    scanner->state = LINK_SCAN_TAG;
+                    scanner->match = 0;
+                    scanner->afterSpace = 0;
+                    scanner->afterEquals = 0;
+                }
+                break;
+            case LINK_SCAN_TAG:
+                if (c == '>') {
+                    scanner->state = LINK_SCAN_TEXT;
+                } else if (scanner->afterEquals && (c == '"' || c == '\'')) {
+                    scanner->quote = c;
+                    scanner->state = LINK_SCAN_SKIP;
+                    scanner->match = 0;
+                } else if ((scanner->match > 0 || scanner->afterSpace) && tolower((unsigned char)c) == "href"[scanner->match]) {
+                    if (++scanner->match == 4) {
+                        scanner->state = LINK_SCAN_NAME;
+                    }
+                } else {
+                    scanner->match = 0;
+                }
+                scanner->afterSpace = isspace((unsigned char)c);
+                scanner->afterEquals = c == '=' || (scanner->afterEquals && isspace((unsigned char)c));
+                break;
+            case LINK_SCAN_SKIP:
+                if (c == scanner->quote) {
+                    scanner->state = LINK_SCAN_TAG;
+                    scanner->afterSpace = 0;
+                    scanner->afterEquals = 0;
+                }
+                break;
+            case LINK_SCAN_NAME:
+                if (c == '=') {
+                    scanner->state = LINK_SCAN_EQUALS;
+                } else if (!isspace((unsigned char)c)) {
+                    // Some other attribute that merely starts with "href"
+                    scanner->state = c == '>' ? LINK_SCAN_TEXT : LINK_SCAN_TAG;
+                    scanner->match = 0;
+                    scanner->afterSpace = 0;
+                    scanner->afterEquals = 0;
+                }
+                break;
+            case LINK_SCAN_EQUALS:
+                if (isspace((unsigned char)c)) {
+                    break;
+                }
+                scanner->valueLength = 0;
+                scanner->overflow = 0;
+                scanner->state = LINK_SCAN_VALUE;
+                if (c == '"' || c == '\'') {
+                    scanner->quote = c;
+                    break;
+                }
+                scanner->quote = 0;
+                // Unquoted value: this character is its first
+                // fall through
+            case LINK_SCAN_VALUE:
+                if ((scanner->quote != 0 && c == scanner->quote) ||
+                    (scanner->quote == 0 && (isspace((unsigned char)c) || c == '>'))) {
+                    if (!scanner->overflow && scanner->valueLength > 0) {
+                        scanner->value[scanner->valueLength] = '\0';
+                        frontierAdd(transfer, scanner->value);
+                    }
+                    scanner->state = c == '>' ? LINK_SCAN_TEXT : LINK_SCAN_TAG;
+                    scanner->match = 0;
+                    scanner->afterSpace = scanner->quote == 0;
+                    scanner->afterEquals = 0;
+                } else if (scanner->valueLength + 1 < sizeof(scanner->value)) {
+                    scanner->value[scanner->valueLength++] = c;
+                } else {
+                    scanner->overflow = 1;
+                }
+                break;
+        }
+    }
+}
+
+// Whether a response is HTML. A missing Content-Type is given the benefit
+// of the doubt.
+int htmlContentType(const char* contentType) {
+    return contentType == NULL || strncasecmp(contentType, "text/html", 9) == 0 ||
+           strncasecmp(contentType, "application/xhtml", 17) == 0;
+}
+
+// Resolve a link found on a page and queue it if it is new and within the
+// crawl limits. Duplicates are rejected by the seen set before touching the
+// job store or the queue, so the common case takes only one shard lock.
+void frontierAdd(Transfer* transfer, char* link) {
+    LinkScanner* scanner = &transfer->links;
+    ThreadData* parent = transfer->job;
+    
+    // Undo the one entity that routinely appears in hrefs
+    char* amp;
+    while ((amp = strstr(link, "&amp;")) != NULL) {
+        memmove(amp + 1, amp + 5, strlen(amp + 5) + 1);
+    }
+    
+    CURLU* url = curl_url_dup(scanner->base);
+    char* scheme = NULL;
+    char* host = NULL;
+    char* text = NULL;
+    
+    if (url == NULL || curl_url_set(url, CURLUPART_URL, link, 0) != CURLUE_OK) {
+        curl_url_cleanup(url);
+        return;
+    }
+    curl_url_set(url, CURLUPART_FRAGMENT, NULL, 0);
+    
+    int wanted = curl_url_get(url, CURLUPART_SCHEME, &scheme, 0) == CURLUE_OK &&
+                 (strcmp(scheme, "http") == 0 || strcmp(scheme, "https") == 0) &&
+                 curl_url_get(url, CURLUPART_URL, &text, 0) == CURLUE_OK;
+    if (wanted && sameHostOnly) {
+        wanted = curl_url_get(url, CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+                 strcasecmp(host, scanner->host) == 0;
+    }
+    
+    size_t length = wanted ? strlen(text) : 0;
+    if (wanted && length < MAX_URL_LENGTH && seenInsert(urlKey(text, length))) {
+        // Soft cap: may overshoot by a few pages when many workers add at once
+        if (maxPages <= 0 || __atomic_load_n(&urlCount, __ATOMIC_RELAXED) < maxPages) {
+            int index = jobAppend(text, length);
+            if (index >= 0) {
+                __atomic_store_n(&jobAt(index)->depth, parent->depth + 1, __ATOMIC_RELAXED);
+                journalJobAdded(jobAt(index));
+                if (activeQueue != NULL) {
+                    queuePush(activeQueue, index);
+                }
+            }
+        }
+    }
+    
+    curl_free(scheme);
+    curl_free(host);
+    curl_free(text);
+    curl_url_cleanup(url);
+}
+
+// Dedup key for a URL: FNV-1a, remixed so the top bits pick a shard evenly.
+// Zero marks an empty slot, so it is never returned.
+uint64_t urlKey(const char* url, size_t length) {
+    uint64_t key = mix64(hashBytes(FNV_OFFSET, url, length));
+    return key != 0 ? key : 1;
+}
+
+// Add a key to the URL-seen set. Returns 1 if it was not there before.
+// Each shard has its own lock, so workers discovering links rarely contend.
+int seenInsert(uint64_t key) {
+    SeenShard* shard = &seenShards[key >> (64 - SEEN_SHARD_BITS)];
+    
+    pthread_mutex_lock(&shard->lock);
+    
+    // Keep the load factor at or below one half
+    if ((shard->count + 1) * 2 > shard->capacity) {
+        int capacity = shard->capacity ? shard->capacity * 2 : INITIAL_SEEN_CAPACITY;
+        uint64_t* keys = (uint64_t*)calloc(capacity, sizeof(uint64_t));
+        if (keys == NULL) {
+            pthread_mutex_unlock(&shard->lock);
+            return 0;
+        }
+        for (int i = 0; i < shard->capacity; i++) {
+            if (shard->keys[i] != 0) {
+                int slot = (int)(shard->keys[i] & (capacity - 1));
+                while (keys[slot] != 0) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                keys[slot] = shard->keys[i];
+            }
+        }
+        free(shard->keys);
+        shard->keys = keys;
+        shard->capacity = capacity;
+    }
+    
+    int slot = (int)(key & (shard->capacity - 1));
+    while (shard->keys[slot] != 0) {
+        if (shard->keys[slot] == key) {
+            pthread_mutex_unlock(&shard->lock);
+            return 0;
+        }
+        slot = (slot + 1) & (shard->capacity - 1);
+    }
+    shard->keys[slot] = key;
+    shard->count++;
+    
+    pthread_mutex_unlock(&shard->lock);
+    return 1;
+}
+
+// Mark a seed URL as seen, in the same normalized form links are compared in
+void seenAddSeed(const char* url, size_t length) {
+    CURLU* parsed = curl_url();
+    char* text = NULL;
+    
+    if (parsed != NULL && curl_url_set(parsed, CURLUPART_URL, url, 0) == CURLUE_OK &&
+        curl_url_set(parsed, CURLUPART_FRAGMENT, NULL, 0) == CURLUE_OK &&
+        curl_url_get(parsed, CURLUPART_URL, &text, 0) == CURLUE_OK) {
+        seenInsert(urlKey(text, strlen(text)));
+    } else {
+        seenInsert(urlKey(url, length));
+    }
+    
+    curl_free(text);
+    curl_url_cleanup(parsed);
+}
+
+// Empty the URL-seen set
+void seenReset() {
+    for (int i = 0; i < SEEN_SHARDS; i++) {
+        pthread_mutex_lock(&seenShards[i].lock);
+        free(seenShards[i].keys);
+        seenShards[i].keys = NULL;
+        seenShards[i].count = 0;
+        seenShards[i].capacity = 0;
+        pthread_mutex_unlock(&seenShards[i].lock);
+    }
+}
+
+// Look up a job by index
+ThreadData* jobAt(int index) {
+    return &jobBlocks[index >> JOB_BLOCK_SHIFT][index & (JOB_BLOCK_SIZE - 1)];
+}
+
+// Append a job for a URL; safe to call from workers.
+// Returns the new job index, or -1 if out of memory or capacity.
+int jobAppend(const char* url, size_t length) {
+    pthread_mutex_lock(&urlLock);
+    
+    // Check for room before interning, so a full store wastes no arena space
+    int index = -1;
+    if ((urlCount >> JOB_BLOCK_SHIFT) < MAX_JOB_BLOCKS && length <= UINT32_MAX) {
+        const char* interned = arenaIntern(&urlArena, url, length);
+        if (interned != NULL) {
+            index = jobInsert(interned, length);
+            url = interned;
+        }
+    }
+    
+    pthread_mutex_unlock(&urlLock);
+    
+    if (index >= 0) {
+        dnsPrefetch(url, length);
+    }
+    return index;
+}
+
+// Add a job whose URL is already a stable, NUL-terminated string, such as
+// an interned copy or a line of the mapped seed file (caller holds urlLock).
+// Returns the new job index, or -1 if out of memory or capacity.
+int jobInsert(const char* url, size_t length) {
+    int index = urlCount;
+    int block = index >> JOB_BLOCK_SHIFT;
+    
+    if (block >= MAX_JOB_BLOCKS || length > UINT32_MAX) {
+        return -1;
+    }
+    
+    if (jobBlocks[block] == NULL) {
+        jobBlocks[block] = (ThreadData*)malloc(JOB_BLOCK_SIZE * sizeof(ThreadData));
+        if (jobBlocks[block] == NULL) {
+            return -1;
+        }
+    }
+    
+    ThreadData* data = jobAt(index);
+    data->url = url;
+    data->urlLength = (uint32_t)length;
+    data->threadID = index;
+    data->workerID = -1;
+    data->success = 0;
+    data->dataSize = 0;
+    data->startTime = 0;
+    data->endTime = 0;
+    data->hostIndex = -1;
+    data->nextInHost = -1;
+    data->attempts = 0;
+    data->notModified = 0;
+    data->depth = 0;
+    data->duplicate = 0;
+    data->resumed = 0;
+    data->checkpointed = 0;
+    data->multiplexed = 0;
+    urlCount++;
+    return index;
+}
+
+// Drop every job and interned URL
+void jobStoreReset() {
+    pthread_mutex_lock(&urlLock);
+    
+    for (int i = 0; i < MAX_JOB_BLOCKS && jobBlocks[i] != NULL; i++) {
+        free(jobBlocks[i]);
+        jobBlocks[i] = NULL;
+    }
+    
+    while (urlArena != NULL) {
+        ArenaBlock* next = urlArena->next;
+        free(urlArena);
+        urlArena = next;
+    }
+    
+    if (seedMap != NULL) {
+        munmap(seedMap, seedMapLength);
+        seedMap = NULL;
+        seedMapLength = 0;
+    }
+    
+    urlCount = 0;
+    pthread_mutex_unlock(&urlLock);
+}
+
+// Copy a string into an arena (caller holds the arena's lock)
+const char* arenaIntern(ArenaBlock** arena, const char* text, size_t length) {
+    if (*arena == NULL || (*arena)->capacity - (*arena)->used < length + 1) {
+        size_t capacity = length + 1 > ARENA_BLOCK_SIZE ? length + 1 : ARENA_BLOCK_SIZE;
+        ArenaBlock* block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + capacity);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->next = *arena;
+        block->used = 0;
+        block->capacity = capacity;
+        *arena = block;
+    }
+    
+    char* copy = (*arena)->data + (*arena)->used;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    (*arena)->used += length + 1;
+    return copy;
+}
+
+// Output file for a job, derived from its ID
+void jobOutputPath(const ThreadData* data, char* path, size_t size) {
+    snprintf(path, size, "%s/page_%d.html%s", outputDir, data->threadID + 1,
+             compressMode == COMPRESS_ZSTD ? ".zst" : "");
+}
+
+// FNV-1a 64-bit hash, continuing from a previous value
+uint64_t hashBytes(uint64_t hash, const void* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// Where the cache index lives
+void cacheIndexPath(char* path, size_t size) {
+    snprintf(path, size, "%s/%s", outputDir, CACHE_INDEX_FILE);
+}
+
+// Find the entry for a URL (caller holds cache.lock). Returns -1 if absent.
+int cacheFind(const char* url, size_t length) {
+    if (cache.tableSize == 0) {
+        return -1;
+    }
+    
+    uint32_t mask = (uint32_t)cache.tableSize - 1;
+    uint32_t slot = (uint32_t)hashBytes(FNV_OFFSET, url, length) & mask;
+    while (cache.table[slot] >= 0) {
+        CacheEntry* entry = &cache.entries[cache.table[slot]];
+        if (entry->urlLength == length && memcmp(entry->url, url, length) == 0) {
+            return cache.table[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+// Add or replace the entry for a URL (caller holds cache.lock).
+// Returns 0 on success, -1 if out of memory.
+int cacheStore(const char* url, size_t urlLength, const char* etag, const char* lastModified,
+               const char* path, uint64_t contentHash, uint64_t size, uint64_t storedSize) {
+    int index = cacheFind(url, urlLength);
+    
+    if (index < 0) {
+        // Keep the table at most half full
+        if (cache.count == cache.capacity) {
+            int capacity = cache.capacity ? cache.capacity * 2 : INITIAL_CACHE_CAPACITY;
+            int tableSize = capacity * 2;
+            CacheEntry* entries = (CacheEntry*)realloc(cache.entries, capacity * sizeof(CacheEntry));
+            if (entries == NULL) {
+                return -1;
+            }
+            cache.entries = entries;
+            int* table = (int*)malloc(tableSize * sizeof(int));
+            if (table == NULL) {
+                return -1;
+            }
+            memset(table, 0xff, tableSize * sizeof(int));
+            for (int i = 0; i < cache.count; i++) {
+                uint32_t slot = (uint32_t)hashBytes(FNV_OFFSET, entries[i].url, entries[i].urlLength) & (tableSize - 1);
+                while (table[slot] >= 0) {
+                    slot = (slot + 1) & (tableSize - 1);
+                }
+                table[slot] = i;
+            }
+            free(cache.table);
+            cache.table = table;
+            cache.tableSize = tableSize;
+            cache.capacity = capacity;
+        }
+        
+        const char* key = arenaIntern(&cache.arena, url, urlLength);
+        if (key == NULL) {
+            return -1;
+        }
+        
+        uint32_t mask = (uint32_t)cache.tableSize - 1;
+        uint32_t slot = (uint32_t)hashBytes(FNV_OFFSET, url, urlLength) & mask;
+        while (cache.table[slot] >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        index = cache.count++;
+        cache.table[slot] = index;
+        cache.entries[index].url = key;
+        cache.entries[index].urlLength = (uint32_t)urlLength;
+    }
+    
+    // Replaced strings stay in the arena until the index is reset
+    CacheEntry* entry = &cache.entries[index];
+    entry->etag = arenaIntern(&cache.arena, etag, strlen(etag));
+    entry->lastModified = arenaIntern(&cache.arena, lastModified, strlen(lastModified));
+    entry->path = arenaIntern(&cache.arena, path, strlen(path));
+    entry->contentHash = contentHash;
+    entry->size = size;
+    entry->storedSize = storedSize;
+    if (entry->etag == NULL || entry->lastModified == NULL || entry->path == NULL) {
+        entry->etag = "";
+        entry->lastModified = "";
+        entry->path = "";
+        return -1;
+    }
+    return 0;
+}
+
+// Load the cache index written by an earlier run. Lines are url, etag,
+// last-modified, content hash, size, size on disk and path, separated by tabs.
+// Returns the number of entries, or -1 if there is no index.
+int cacheLoad() {
+    char path[MAX_PATH_LENGTH];
+    cacheIndexPath(path, sizeof(path));
+    
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t length;
+    int count = 0;
+    
+    pthread_mutex_lock(&cache.lock);
+    while ((length = getline(&line, &lineCapacity, file)) != -1) {
+        char* fields[7];
+        int fieldCount = 0;
+        char* cursor = line;
+        
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        
+        while (fieldCount < 7) {
+            fields[fieldCount++] = cursor;
+            char* tab = strchr(cursor, '\t');
+            if (tab == NULL) {
+                break;
+            }
+            *tab = '\0';
+            cursor = tab + 1;
+        }
+        if (fieldCount < 7 || fields[0][0] == '\0') {
+            continue;
+        }
+        
+        if (cacheStore(fields[0], strlen(fields[0]), fields[1], fields[2], fields[6],
+                       strtoull(fields[3], NULL, 16), strtoull(fields[4], NULL, 10),
+                       strtoull(fields[5], NULL, 10)) != 0) {
+            break;
+        }
+        count++;
+    }
+    pthread_mutex_unlock(&cache.lock);
+    
+    free(line);
+    fclose(file);
+    return count;
+}
+
+// Write the cache index, replacing the old one only once it is complete
+int cacheSave() {
+    char path[MAX_PATH_LENGTH];
+    char tempPath[MAX_PATH_LENGTH + 8];
+    cacheIndexPath(path, sizeof(path));
+    tempPathFor(path, tempPath, sizeof(tempPath));
+    
+    FILE* file = fopen(tempPath, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&cache.lock);
+    for (int i = 0; i < cache.count; i++) {
+        CacheEntry* entry = &cache.entries[i];
+        fprintf(file, "%.*s\t%s\t%s\t%016llx\t%llu\t%llu\t%s\n",
+                (int)entry->urlLength, entry->url, entry->etag, entry->lastModified,
+                (unsigned long long)entry->contentHash, (unsigned long long)entry->size,
+                (unsigned long long)entry->storedSize, entry->path);
+    }
+    pthread_mutex_unlock(&cache.lock);
+    
+    if (fclose(file) != 0 || rename(tempPath, path) != 0) {
+        unlink(tempPath);
+        return -1;
+    }
+    return 0;
+}
+
+// Drop every cache entry
+void cacheReset() {
+    pthread_mutex_lock(&cache.lock);
+    free(cache.entries);
+    free(cache.table);
+    while (cache.arena != NULL) {
+        ArenaBlock* next = cache.arena->next;
+        free(cache.arena);
+        cache.arena = next;
+    }
+    cache.entries = NULL;
+    cache.table = NULL;
+    cache.count = 0;
+    cache.capacity = 0;
+    cache.tableSize = 0;
+    pthread_mutex_unlock(&cache.lock);
+}
+
+// Ask for the page only if it changed since the copy already on disk. The
+// saved validators are only trusted if that copy is still intact at this
+// job's output path, or anywhere in the content store with --cas.
+void cacheAddValidators(Transfer* transfer, ThreadData* data) {
+    char etagHeader[MAX_VALIDATOR_LENGTH + 32];
+    char modifiedHeader[MAX_VALIDATOR_LENGTH + 32];
+    char savedPath[MAX_PATH_LENGTH];
+    char objectPrefix[MAX_PATH_LENGTH];
+    uint64_t size = 0;
+    uint64_t storedSize = 0;
+    int entryIndex = -1;
+    
+    etagHeader[0] = '\0';
+    modifiedHeader[0] = '\0';
+    snprintf(objectPrefix, sizeof(objectPrefix), "%s/%s/", outputDir, CAS_DIR);
+    
+    pthread_mutex_lock(&cache.lock);
+    int index = cacheFind(data->url, data->urlLength);
+    if (index >= 0) {
+        CacheEntry* entry = &cache.entries[index];
+        int samePath = casMode ? strncmp(entry->path, objectPrefix, strlen(objectPrefix)) == 0
+                               : strcmp(entry->path, transfer->outputPath) == 0;
+        if (samePath && (entry->etag[0] != '\0' || entry->lastModified[0] != '\0')) {
+            entryIndex = index;
+            snprintf(savedPath, sizeof(savedPath), "%s", entry->path);
+            size = entry->size;
+            storedSize = entry->storedSize;
+            if (entry->etag[0] != '\0') {
+                snprintf(etagHeader, sizeof(etagHeader), "If-None-Match: %s", entry->etag);
+            }
+            if (entry->lastModified[0] != '\0') {
+                snprintf(modifiedHeader, sizeof(modifiedHeader), "If-Modified-Since: %s", entry->lastModified);
+            }
+        }
+    }
+    pthread_mutex_unlock(&cache.lock);
+    
+    struct stat info;
+    if (entryIndex < 0 || stat(savedPath, &info) != 0 || (uint64_t)info.st_size != storedSize) {
+        return;
+    }
+    
+    if (etagHeader[0] != '\0') {
+        transfer->headers = curl_slist_append(transfer->headers, etagHeader);
+    }
+    if (modifiedHeader[0] != '\0') {
+        transfer->headers = curl_slist_append(transfer->headers, modifiedHeader);
+    }
+    if (transfer->headers != NULL) {
+        transfer->cacheEntry = entryIndex;
+        transfer->cachedSize = size;
+    }
+}
+
+// Remember the validators and content hash of a freshly saved page
+void cacheRecord(Transfer* transfer, uint64_t size, uint64_t storedSize) {
+    ThreadData* data = transfer->job;
+    
+    pthread_mutex_lock(&cache.lock);
+    cacheStore(data->url, data->urlLength, transfer->etag, transfer->lastModified,
+               transfer->outputPath, transfer->contentHash, size, storedSize);
+    pthread_mutex_unlock(&cache.lock);
+}
+
+// curl header callback: keep the validators of the final response
+size_t headerCallback(char* buffer, size_t size, size_t nitems, void* userp) {
+    size_t length = size * nitems;
+    Transfer* transfer = (Transfer*)userp;
+    
+    // Each status line starts a new response (redirects, 100 Continue)
+    if (length >= 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        transfer->etag[0] = '\0';
+        transfer->lastModified[0] = '\0';
+    } else {
+        headerValue(buffer, length, "ETag", transfer->etag, sizeof(transfer->etag));
+        headerValue(buffer, length, "Last-Modified", transfer->lastModified, sizeof(transfer->lastModified));
+    }
+    return length;
+}
+
+// Copy the value of a header line if it has the given name. Values that
+// are too long or contain tabs are ignored, since they can't be indexed.
+int headerValue(const char* line, size_t length, const char* name, char* value, size_t size) {
+    size_t nameLength = strlen(name);
+    
+    if (length <= nameLength || line[nameLength] != ':' || strncasecmp(line, name, nameLength) != 0) {
+        return 0;
+    }
+    
+    size_t start = nameLength + 1;
+    size_t end = length;
+    while (start < end && (line[start] == ' ' || line[start] == '\t')) {
+        start++;
+    }
+    while (end > start && isspace((unsigned char)line[end - 1])) {
+        end--;
+    }
+    if (end - start >= size || memchr(line + start, '\t', end - start) != NULL) {
+        return 0;
+    }
+    
+    memcpy(value, line + start, end - start);
+    value[end - start] = '\0';
+    return 1;
+}
+
+// Start the resolver pool
+void dnsStart() {
+    memset(&dnsCache, 0, sizeof(DnsCache));
+    dnsCache.queueHead = -1;
+    dnsCache.queueTail = -1;
+    pthread_mutex_init(&dnsCache.lock, NULL);
+    pthread_cond_init(&dnsCache.work, NULL);
+    
+    for (int i = 0; i < dnsThreads; i++) {
+        if (pthread_create(&dnsCache.threads[dnsCache.threadCount], NULL, dnsResolverMain, NULL) == 0) {
+            dnsCache.threadCount++;
+        }
+    }
+    if (dnsThreads > 0 && dnsCache.threadCount == 0) {
+        printf("Warning: could not start resolver threads; libcurl will resolve names itself.\n");
+    }
+}
+
+// Stop the resolver pool and drop the cache
+void dnsStop() {
+    pthread_mutex_lock(&dnsCache.lock);
+    dnsCache.stopping = 1;
+    pthread_cond_broadcast(&dnsCache.work);
+    pthread_mutex_unlock(&dnsCache.lock);
+    
+    for (int i = 0; i < dnsCache.threadCount; i++) {
+        pthread_join(dnsCache.threads[i], NULL);
+    }
+    dnsCache.threadCount = 0;
+    
+    free(dnsCache.entries);
+    free(dnsCache.table);
+    while (dnsCache.arena != NULL) {
+        ArenaBlock* next = dnsCache.arena->next;
+        free(dnsCache.arena);
+        dnsCache.arena = next;
+    }
+    pthread_mutex_destroy(&dnsCache.lock);
+    pthread_cond_destroy(&dnsCache.work);
+}
+
+// Queue a lookup for the host of a URL unless the cache already has a
+// fresh answer or one is on the way. Called as jobs are added, so names
+// resolve while the rest of the job list is still loading.
+void dnsPrefetch(const char* url, size_t length) {
+    if (dnsCache.threadCount == 0) {
+        return;
+    }
+    
+    size_t hostStart, hostLength, originLength;
+    urlHostPart(url, length, &hostStart, &hostLength, &originLength);
+    
+    if (!dnsWantsLookup(url + hostStart, hostLength)) {
+        return;
+    }
+    
+    pthread_mutex_lock(&dnsCache.lock);
+    int index = dnsFind(url + hostStart, hostLength, 1);
+    if (index >= 0) {
+        dnsRefresh(index, monotonicNanos());
+    }
+    pthread_mutex_unlock(&dnsCache.lock);
+}
+
+// Whether a host name needs resolving at all (IP literals don't)
+int dnsWantsLookup(const char* name, size_t length) {
+    if (length == 0 || length >= MAX_HOST_NAME || name[0] == '[') {
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (!isdigit((unsigned char)name[i]) && name[i] != '.') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Find a host's cache entry, optionally adding an empty one (caller holds
+// the cache lock). Returns the entry index, or -1.
+int dnsFind(const char* name, size_t length, int create) {
+    if (dnsCache.tableSize > 0) {
+        uint32_t slot = hostHash(name, length) & (dnsCache.tableSize - 1);
+        while (dnsCache.table[slot] >= 0) {
+            DnsEntry* entry = &dnsCache.entries[dnsCache.table[slot]];
+            if (entry->nameLength == length && strncasecmp(entry->name, name, length) == 0) {
+                return dnsCache.table[slot];
+            }
+            slot = (slot + 1) & (dnsCache.tableSize - 1);
+        }
+    }
+    if (!create) {
+        return -1;
+    }
+    
+    // Grow the entries and the table together, keeping the table at most half full
+    if (dnsCache.count == dnsCache.capacity) {
+        int capacity = dnsCache.capacity ? dnsCache.capacity * 2 : INITIAL_DNS_TABLE / 2;
+        DnsEntry* entries = (DnsEntry*)realloc(dnsCache.entries, capacity * sizeof(DnsEntry));
+        int* table = (int*)malloc(capacity * 2 * sizeof(int));
+        if (entries == NULL || table == NULL) {
+            if (entries != NULL) {
+                dnsCache.entries = entries;
+            }
+            free(table);
+            return -1;
+        }
+        dnsCache.entries = entries;
+        dnsCache.capacity = capacity;
+        
+        free(dnsCache.table);
+        dnsCache.table = table;
+        dnsCache.tableSize = capacity * 2;
+        memset(table, 0xff, dnsCache.tableSize * sizeof(int));
+        for (int i = 0; i < dnsCache.count; i++) {
+            uint32_t slot = hostHash(entries[i].name, entries[i].nameLength) & (dnsCache.tableSize - 1);
+            while (table[slot] >= 0) {
+                slot = (slot + 1) & (dnsCache.tableSize - 1);
+            }
+            table[slot] = i;
+        }
+    }
+    
+    const char* interned = arenaIntern(&dnsCache.arena, name, length);
+    if (interned == NULL) {
+        return -1;
+    }
+    
+    int index = dnsCache.count++;
+    DnsEntry* entry = &dnsCache.entries[index];
+    entry->name = interned;
+    entry->nameLength = (uint32_t)length;
+    entry->state = DNS_EMPTY;
+    entry->expires = 0;
+    entry->addresses[0] = '\0';
+    entry->next = -1;
+    
+    uint32_t slot = hostHash(name, length) & (dnsCache.tableSize - 1);
+    while (dnsCache.table[slot] >= 0) {
+        slot = (slot + 1) & (dnsCache.tableSize - 1);
+    }
+    dnsCache.table[slot] = index;
+    return index;
+}
+
+// Queue a lookup for an entry that has never been resolved or whose answer
+// has expired (caller holds the cache lock)
+void dnsRefresh(int index, uint64_t now) {
+    DnsEntry* entry = &dnsCache.entries[index];
+    
+    if (entry->state == DNS_PENDING || (entry->state != DNS_EMPTY && entry->expires > now)) {
+        return;
+    }
+    
+    entry->state = DNS_PENDING;
+    entry->next = -1;
+    if (dnsCache.queueTail >= 0) {
+        dnsCache.entries[dnsCache.queueTail].next = index;
+    } else {
+        dnsCache.queueHead = index;
+    }
+    dnsCache.queueTail = index;
+    pthread_cond_signal(&dnsCache.work);
+}
+
+// Resolver thread: run blocking getaddrinfo calls off the fetch path and
+// store the answers for every worker to use
+void* dnsResolverMain(void* arg) {
+    (void)arg;
+    char name[MAX_HOST_NAME];
+    char addresses[DNS_ADDRESS_LENGTH];
+    
+    pthread_mutex_lock(&dnsCache.lock);
+    while (1) {
+        while (dnsCache.queueHead < 0 && !dnsCache.stopping) {
+            pthread_cond_wait(&dnsCache.work, &dnsCache.lock);
+        }
+        if (dnsCache.stopping) {
+            break;
+        }
+        
+        int index = dnsCache.queueHead;
+        DnsEntry* entry = &dnsCache.entries[index];
+        dnsCache.queueHead = entry->next;
+        if (dnsCache.queueHead < 0) {
+            dnsCache.queueTail = -1;
+        }
+        memcpy(name, entry->name, entry->nameLength);
+        name[entry->nameLength] = '\0';
+        pthread_mutex_unlock(&dnsCache.lock);
+        
+        int found = dnsLookup(name, addresses, sizeof(addresses));
+        
+        pthread_mutex_lock(&dnsCache.lock);
+        entry = &dnsCache.entries[index];
+        entry->state = found ? DNS_READY : DNS_FAILED;
+        entry->expires = monotonicNanos() + (uint64_t)(found ? dnsTtl : DNS_NEGATIVE_TTL) * 1000000000ULL;
+        strcpy(entry->addresses, addresses);
+    }
+    pthread_mutex_unlock(&dnsCache.lock);
+    
+    return NULL;
+}
+
+// Resolve a name into a comma-separated address list as CURLOPT_RESOLVE
+// takes it (IPv6 in brackets). Returns 1 if any address was found.
+int dnsLookup(const char* name, char* addresses, size_t size) {
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+    size_t used = 0;
+    int count = 0;
+    
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addresses[0] = '\0';
+    
+    if (getaddrinfo(name, NULL, &hints, &result) != 0) {
+        return 0;
+    }
+    
+    for (struct addrinfo* info = result; info != NULL && count < MAX_DNS_ADDRESSES; info = info->ai_next) {
+        char text[INET6_ADDRSTRLEN];
+        const void* address;
+        if (info->ai_family == AF_INET) {
+            address = &((struct sockaddr_in*)info->ai_addr)->sin_addr;
+        } else if (info->ai_family == AF_INET6) {
+            address = &((struct sockaddr_in6*)info->ai_addr)->sin6_addr;
+        } else {
+            continue;
+        }
+        if (inet_ntop(info->ai_family, address, text, sizeof(text)) == NULL) {
+            continue;
+        }
+        
+        int written = snprintf(addresses + used, size - used, info->ai_family == AF_INET6 ? "%s[%s]" : "%s%s",
+                               count > 0 ? "," : "", text);
+        if (written < 0 || (size_t)written >= size - used) {
+            addresses[used] = '\0';
+            break;
+        }
+        used += written;
+        count++;
+    }
+    
+    freeaddrinfo(result);
+    return count > 0;
+}
+
+// Hand libcurl the cached addresses for a job's host so the transfer skips
+// its own lookup. Misses and expired answers fall back to libcurl's resolver
+// (and queue a refresh); nothing here ever waits for a lookup.
+void dnsAddResolve(Transfer* transfer, ThreadData* data) {
+    size_t hostStart, hostLength, originLength;
+    urlHostPart(data->url, data->urlLength, &hostStart, &hostLength, &originLength);
+    const char* name = data->url + hostStart;
+    
+    if (dnsCache.threadCount == 0 || !dnsWantsLookup(name, hostLength)) {
+        return;
+    }
+    
+    // Port from the URL, else the scheme's default
+    const char* port = strncasecmp(data->url, "https:", 6) == 0 ? "443" : "80";
+    size_t portLength = strlen(port);
+    size_t portStart = hostStart + hostLength;
+    if (portStart < originLength && data->url[portStart] == ':' && originLength - portStart > 1) {
+        port = data->url + portStart + 1;
+        portLength = originLength - portStart - 1;
+    }
+    
+    char entry[MAX_HOST_NAME + DNS_ADDRESS_LENGTH + 16];
+    int ready = 0;
+    
+    pthread_mutex_lock(&dnsCache.lock);
+    int index = dnsFind(name, hostLength, 1);
+    if (index >= 0) {
+        uint64_t now = monotonicNanos();
+        DnsEntry* cached = &dnsCache.entries[index];
+        if (cached->state == DNS_READY && cached->expires > now) {
+            // "+" lets libcurl's own cache expire the entry like a lookup
+            snprintf(entry, sizeof(entry), "+%.*s:%.*s:%s", (int)hostLength, name,
+                     (int)portLength, port, cached->addresses);
+            ready = 1;
+        } else {
+            dnsRefresh(index, now);
+        }
+    }
+    pthread_mutex_unlock(&dnsCache.lock);
+    
+    if (ready) {
+        transfer->resolve = curl_slist_append(NULL, entry);
+        if (transfer->resolve != NULL) {
+            curl_easy_setopt(transfer->curl, CURLOPT_RESOLVE, transfer->resolve);
+        }
+    }
+}
+
+// Pool worker: pull jobs from the shared queue until it is drained
+void* workerMain(void* arg) {
+    WorkerContext* context = (WorkerContext*)arg;
+    int jobIndex;
+    
+    // Each worker keeps one easy handle across jobs and across scraping runs
+    if (workerHandles[context->workerID] == NULL) {
+        workerHandles[context->workerID] = curl_easy_init();
+    }
+    CURL* curl = workerHandles[context->workerID];
+    
+    // Don't take a job while the memory budget is spent
+    while (budgetAdmit(BUDGET_WAIT) && queuePop(context->queue, &jobIndex)) {
+        ThreadData* data = jobAt(jobIndex);
+        data->workerID = context->workerID;
+        data->startTime = monotonicNanos();
+        
+        progressJobStarted(data);
+        uint64_t delay = scrapeURL(data, curl);
+        progressJobFinished(data, delay);
+        journalJobFinished(data, delay);
+        
+        if (delay > 0) {
+            queueRetry(context->queue, jobIndex, delay);
+        } else {
+            queueJobDone(context->queue, jobIndex);
+        }
+    }
+    
+    return NULL;
+}
+
+// Scrape a single URL on a worker's persistent handle.
+// Returns the backoff in nanoseconds if the job should be retried, else 0.
+uint64_t scrapeURL(ThreadData* data, CURL* curl) {
+    Transfer transfer;
+    CURLcode res;
+    
+    if (curl == NULL) {
+        workerLog("Worker %d ERROR (URL %d): Failed to initialize curl\n", data->workerID + 1, data->threadID + 1);
+        data->success = 0;
+        data->endTime = monotonicNanos();
+        return 0;
+    }
+    
+    // Reset options but keep live connections and caches
+    curl_easy_reset(curl);
+    
+    if (transferSetup(&transfer, curl, data) != 0) {
+        workerLog("Worker %d ERROR (URL %d): Out of memory\n", data->workerID + 1, data->threadID + 1);
+        data->success = 0;
+        data->endTime = monotonicNanos();
+        return 0;
+    }
+    
+    // Perform the request
+    res = curl_easy_perform(curl);
+    
+    return transferFinish(&transfer, res);
+}
+
+// Create the share handle used by every transfer. It carries DNS entries
+// and TLS sessions only: libcurl can't share a connection cache between
+// threads running transfers at once, so connections are reused through each
+// worker's persistent easy handle and each event loop's multi handle.
+void initializeShare() {
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&shareLocks[i], NULL);
+    }
+    
+    shareHandle = curl_share_init();
+    if (shareHandle == NULL) {
+        printf("Warning: curl share handle unavailable; DNS and TLS sessions will not be shared.\n");
+        return;
+    }
+    
+    curl_share_setopt(shareHandle, CURLSHOPT_LOCKFUNC, shareLock);
+    curl_share_setopt(shareHandle, CURLSHOPT_UNLOCKFUNC, shareUnlock);
+    curl_share_setopt(shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+// Release persistent handles and the share handle
+void cleanupShare() {
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        if (workerHandles[i] != NULL) {
+            curl_easy_cleanup(workerHandles[i]);
+            workerHandles[i] = NULL;
+        }
+    }
+    
+    if (shareHandle != NULL) {
+        curl_share_cleanup(shareHandle);
+        shareHandle = NULL;
+    }
+    
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_destroy(&shareLocks[i]);
+    }
+}
+
+// Share handle lock callback: one mutex per kind of shared data
+void shareLock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userp) {
+    (void)handle;
+    (void)access;
+    (void)userp;
+    pthread_mutex_lock(&shareLocks[data]);
+}
+
+// Share handle unlock callback
+void shareUnlock(CURL* handle, curl_lock_data data, void* userp) {
+    (void)handle;
+    (void)userp;
+    pthread_mutex_unlock(&shareLocks[data]);
+}
+
+// Configure an easy handle to fetch a job into memory
+int transferSetup(Transfer* transfer, CURL* curl, ThreadData* data) {
+    transfer->job = data;
+    transfer->curl = curl;
+    transfer->loop = NULL;
+    transfer->budgetHeld = 0;
+    transfer->overdraft = 0;
+    transfer->paused = 0;
+    transfer->tooLarge = 0;
+    jobOutputPath(data, transfer->outputPath, sizeof(transfer->outputPath));
+    transfer->fd = -1;
+    transfer->direct = 0;
+    transfer->written = 0;
+    transfer->rawSize = 0;
+    transfer->writeFailed = 0;
+    transfer->compressor = NULL;
+    transfer->headers = NULL;
+    transfer->cacheEntry = -1;
+    transfer->cachedSize = 0;
+    transfer->contentHash = 0;
+    transfer->etag[0] = '\0';
+    transfer->lastModified[0] = '\0';
+    linkScanInit(&transfer->links, data);
+    transfer->resolve = NULL;
+    
+    if (contentHashInit(transfer) != 0) {
+        return -1;
+    }
+    
+    int acquired;
+    if (storeMode == STORE_STREAM) {
+        acquired = bufferAcquire(&stagingPool, &transfer->chunk, STAGING_BUFFER_SIZE, 1);
+    } else {
+        acquired = bufferAcquire(&bodyPool, &transfer->chunk, INITIAL_BUFFER_SIZE, 0);
+    }
+    if (acquired != 0) {
+        contentHashFree(transfer);
+        return -1;
+    }
+    
+    // The job was admitted against the budget, so its first buffer is charged
+    // unconditionally; only growth can be refused
+    budgetReserve(transfer, transfer->chunk.capacity, BUDGET_FORCE);
+    
+    if (compressMode != COMPRESS_NONE) {
+        transfer->compressor = compressorAcquire();
+        if (transfer->compressor == NULL) {
+            bufferRelease(storeMode == STORE_STREAM ? &stagingPool : &bodyPool, &transfer->chunk);
+            budgetRelease(transfer);
+            contentHashFree(transfer);
+            return -1;
+        }
+    }
+    
+    // Set URL
+    curl_easy_setopt(curl, CURLOPT_URL, data->url);
+    
+    // Use addresses the resolver pool already looked up, and let libcurl's
+    // shared cache keep its own answers for the same TTL
+    dnsAddResolve(transfer, data);
+    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, dnsTtl);
+    
+    // Revalidate pages saved by an earlier run instead of refetching them
+    if (cacheEnabled) {
+        cacheAddValidators(transfer, data);
+        if (transfer->headers != NULL) {
+            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->headers);
+        }
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, headerCallback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void*)transfer);
+    }
+    
+    // Set callback function
+    if (storeMode == STORE_STREAM) {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, streamCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)transfer);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, bodyCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)transfer);
+    }
+    
+    // Follow redirects
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    
+    // Accept every content encoding libcurl can decode (gzip, br, zstd)
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    
+    // Refuse oversized bodies up front when the server sends Content-Length;
+    // the write callbacks catch the rest as they grow
+    if (maxBodySize > 0) {
+        curl_easy_setopt(curl, CURLOPT_MAXFILESIZE_LARGE, (curl_off_t)maxBodySize);
+    }
+    
+    // Set timeouts (30 seconds overall by default)
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, requestTimeoutMs);
+    if (connectTimeoutMs > 0) {
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, connectTimeoutMs);
+    }
+    
+    // Set user agent
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0 (Web Scraper/1.0)");
+    
+    // Avoid signals from the resolver in a multi-threaded process
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    
+    // Lets the event loop find the transfer from a completed handle
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (void*)transfer);
+    
+    // Offer h2 through ALPN, and wait for a connection that may multiplex
+    // rather than opening one per request
+    if (http2Mode) {
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    }
+    
+    // Reuse DNS entries and TLS sessions across handles
+    if (shareHandle != NULL) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, shareHandle);
+    }
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    
+    return 0;
+}
+
+// Record the result of a finished transfer and save its body.
+// Returns the backoff in nanoseconds if the job should be retried, else 0.
+uint64_t transferFinish(Transfer* transfer, CURLcode res) {
+    ThreadData* data = transfer->job;
+    MemoryStruct* chunk = &transfer->chunk;
+    char tempPath[MAX_PATH_LENGTH + 8];
+    uint64_t delay = 0;
+    long status = 0;
+    long version = 0;
+    
+    recordTimings(data, transfer->curl);
+    curl_easy_getinfo(transfer->curl, CURLINFO_RESPONSE_CODE, &status);
+    
+    // Tell the scheduler whether the host multiplexes
+    curl_easy_getinfo(transfer->curl, CURLINFO_HTTP_VERSION, &version);
+    data->multiplexed = version == CURL_HTTP_VERSION_2_0 || version == CURL_HTTP_VERSION_3;
+    int retryType = transfer->writeFailed ? RETRY_NONE : retryClass(res, status);
+    
+    tempPathFor(transfer->outputPath, tempPath, sizeof(tempPath));
+    transfer->contentHash = xxh64Digest(&transfer->hashState);
+    
+    if (retryType != RETRY_NONE && data->attempts < maxRetries) {
+        delay = retryDelay(data, transfer->curl, retryType);
+        data->attempts++;
+        workerLog("Worker %d RETRY (URL %d): %s, retry %d/%d in %.2fs\n", data->workerID + 1, data->threadID + 1,
+               retryPolicies[retryType].name, data->attempts, maxRetries, delay / 1e9);
+        data->success = 0;
+        
+        // Drop any partial download
+        if (transfer->fd >= 0) {
+            close(transfer->fd);
+            transfer->fd = -1;
+            unlink(tempPath);
+        }
+    } else if (res == CURLE_OK && status == 304 && transfer->cacheEntry >= 0) {
+        // The copy saved by an earlier run is still current
+        if (transfer->fd >= 0) {
+            close(transfer->fd);
+            transfer->fd = -1;
+            unlink(tempPath);
+        }
+        data->success = 1;
+        data->notModified = 1;
+        data->dataSize = (size_t)transfer->cachedSize;
+        
+        workerLog("Worker %d UNCHANGED (URL %d): Kept %zu bytes\n",
+               data->workerID + 1, data->threadID + 1, data->dataSize);
+    } else if (res != CURLE_OK || retryType == RETRY_SERVER) {
+        if (transfer->tooLarge || res == CURLE_FILESIZE_EXCEEDED) {
+            workerLog("Worker %d ERROR (URL %d): Body larger than %llu bytes\n", data->workerID + 1, data->threadID + 1,
+                   (unsigned long long)maxBodySize);
+        } else if (transfer->writeFailed) {
+            workerLog("Worker %d ERROR (URL %d): Could not write output file\n", data->workerID + 1, data->threadID + 1);
+        } else if (res == CURLE_OK) {
+            workerLog("Worker %d ERROR (URL %d): HTTP %ld\n", data->workerID + 1, data->threadID + 1, status);
+        } else {
+            workerLog("Worker %d ERROR (URL %d): %s\n", data->workerID + 1, data->threadID + 1, curl_easy_strerror(res));
+        }
+        data->success = 0;
+        
+        // Drop any partial download
+        if (transfer->fd >= 0) {
+            close(transfer->fd);
+            transfer->fd = -1;
+            unlink(tempPath);
+        }
+    } else if (storeMode == STORE_STREAM) {
+        size_t total = transfer->rawSize;
+        int failed = 0;
+        
+        // Bodies that never produced a chunk still get an (empty) file
+        if (transfer->fd < 0 && streamOpen(transfer) != 0) {
+            failed = 1;
+        }
+        if (!failed && transfer->compressor != NULL && compressStream(transfer, NULL, 0, 1) != 0) {
+            failed = 1;
+        }
+        if (!failed && streamFlush(transfer, 1) != 0) {
+            failed = 1;
+        }
+        if (transfer->fd >= 0 && close(transfer->fd) != 0) {
+            failed = 1;
+        }
+        transfer->fd = -1;
+        
+        // In the content store, a body that is already there is not kept twice
+        int duplicate = 0;
+        uint64_t storedSize = transfer->written;
+        if (!failed && casMode) {
+            duplicate = casResolve(transfer, storedSize);
+            failed = duplicate < 0;
+        }
+        if (!failed && duplicate) {
+            unlink(tempPath);
+        } else if (!failed && rename(tempPath, transfer->outputPath) != 0) {
+            failed = 1;
+        }
+        
+        if (failed) {
+            workerLog("Worker %d ERROR (URL %d): Could not write output file\n", data->workerID + 1, data->threadID + 1);
+            unlink(tempPath);
+            data->success = 0;
+        } else {
+            data->success = 1;
+            data->dataSize = total;
+            data->duplicate = duplicate;
+            if (casMode) {
+                casRecord(transfer, total);
+            }
+            if (cacheEnabled) {
+                cacheRecord(transfer, total, storedSize);
+            }
+            
+            workerLog("Worker %d SUCCESS (URL %d): Downloaded %zu bytes%s\n", 
+                   data->workerID + 1, data->threadID + 1, total, duplicate ? " (duplicate)" : "");
+        }
+    } else if (archiveMode) {
+        char* contentType = NULL;
+        curl_easy_getinfo(transfer->curl, CURLINFO_CONTENT_TYPE, &contentType);
+        
+        if (archiveAppend(data->workerID, data, chunk, contentType, transfer->compressor) != 0) {
+            workerLog("Worker %d ERROR (URL %d): Could not write to the archive\n", data->workerID + 1, data->threadID + 1);
+            data->success = 0;
+        } else {
+            data->success = 1;
+            data->dataSize = chunk->size;
+            
+            workerLog("Worker %d SUCCESS (URL %d): Archived %zu bytes\n",
+                   data->workerID + 1, data->threadID + 1, chunk->size);
+        }
+    } else {
+        // Save to file, compressed first if asked
+        MemoryStruct packed = {NULL, 0, 0};
+        const MemoryStruct* stored = chunk;
+        int failed = 0;
+        int duplicate = 0;
+        uint64_t storedSize = 0;
+        
+        if (transfer->compressor != NULL) {
+            failed = compressBody(transfer->compressor, chunk, &packed) != 0;
+            stored = &packed;
+        }
+        
+        // Bodies already in the content store are not written again
+        if (!failed && casMode) {
+            storedSize = stored->size;
+            duplicate = casResolve(transfer, storedSize);
+            failed = duplicate < 0;
+        }
+        if (!failed && !duplicate) {
+            failed = saveBody(transfer->outputPath, tempPath, stored->data, stored->size) != 0;
+            storedSize = stored->size;
+        }
+        bufferRelease(&bodyPool, &packed);
+        
+        if (failed) {
+            workerLog("Worker %d ERROR (URL %d): Could not create output file\n", data->workerID + 1, data->threadID + 1);
+            data->success = 0;
+        } else {
+            data->success = 1;
+            data->dataSize = chunk->size;
+            data->duplicate = duplicate;
+            if (casMode) {
+                casRecord(transfer, chunk->size);
+            }
+            if (cacheEnabled) {
+                cacheRecord(transfer, chunk->size, storedSize);
+            }
+            
+            workerLog("Worker %d SUCCESS (URL %d): Downloaded %zu bytes%s\n", 
+                   data->workerID + 1, data->threadID + 1, chunk->size, duplicate ? " (duplicate)" : "");
+        }
+    }
+    
+    data->endTime = monotonicNanos();
+    
+    // Pass HTML pages on to be parsed; the extraction stage takes the body
+    if (extractFile != NULL && data->success && !data->notModified && status >= 200 && status < 300) {
+        char* contentType = NULL;
+        curl_easy_getinfo(transfer->curl, CURLINFO_CONTENT_TYPE, &contentType);
+        if (htmlContentType(contentType)) {
+            extractSubmit(transfer);
+        }
+    }
+    
+    curl_slist_free_all(transfer->headers);
+    transfer->headers = NULL;
+    linkScanFree(&transfer->links);
+    contentHashFree(transfer);
+    curl_slist_free_all(transfer->resolve);
+    transfer->resolve = NULL;
+    compressorRelease(transfer->compressor);
+    transfer->compressor = NULL;
+    if (storeMode == STORE_STREAM) {
+        bufferRelease(&stagingPool, chunk);
+    } else {
+        bufferRelease(&bodyPool, chunk);
+    }
+    budgetRelease(transfer);
+    return delay;
+}
+
+// Which retry class a finished transfer falls into: timeouts, 5xx/429
+// responses and dropped or refused connections are worth another attempt
+int retryClass(CURLcode res, long status) {
+    switch (res) {
+        case CURLE_OK:
+            return status >= 500 || status == 429 ? RETRY_SERVER : RETRY_NONE;
+        case CURLE_OPERATION_TIMEDOUT:
+            return RETRY_TIMEOUT;
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+            return RETRY_CONNECTION;
+        default:
+            return RETRY_NONE;
+    }
+}
+
+// Backoff before a job's next attempt: the class's base delay doubled per
+// attempt and capped, with equal jitter so jobs that failed together don't
+// retry together. A longer Retry-After from the server wins.
+uint64_t retryDelay(ThreadData* data, CURL* curl, int retryType) {
+    uint64_t limit = (uint64_t)MAX_RETRY_DELAY_MS * 1000000ULL;
+    uint64_t ceiling = (uint64_t)retryPolicies[retryType].baseMs * 1000000ULL;
+    
+    for (int i = 0; i < data->attempts && ceiling < limit; i++) {
+        ceiling *= 2;
+    }
+    if (ceiling > limit) {
+        ceiling = limit;
+    }
+    
+    uint64_t x = mix64(monotonicNanos() ^ ((uint64_t)data->threadID * 0x9E3779B97F4A7C15ULL));
+    uint64_t delay = ceiling / 2 + x % (ceiling / 2 + 1);
+    
+    curl_off_t retryAfter = 0;
+    if (retryType == RETRY_SERVER &&
+        curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retryAfter) == CURLE_OK && retryAfter > 0) {
+        uint64_t requested = (uint64_t)retryAfter * 1000000000ULL;
+        if (requested > limit) {
+            requested = limit;
+        }
+        if (requested > delay) {
+            delay = requested;
+        }
+    }
+    return delay > 0 ? delay : 1;
+}
+
+// Store curl's per-phase timings for a job. curl reports cumulative
+// microsecond offsets from the start of the request; convert them into the
+// time spent in each phase. server is from the request being sent to the
+// first response byte, transfer from there to the last byte.
+void recordTimings(ThreadData* data, CURL* curl) {
+    curl_off_t dns = 0, connect = 0, tls = 0, pretransfer = 0, firstByte = 0, total = 0;
+    
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &firstByte);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    
+    data->phaseMicros[PHASE_DNS] = (uint32_t)dns;
+    data->phaseMicros[PHASE_CONNECT] = connect > dns ? (uint32_t)(connect - dns) : 0;
+    data->phaseMicros[PHASE_TLS] = tls > connect ? (uint32_t)(tls - connect) : 0;
+    data->phaseMicros[PHASE_SERVER] = firstByte > pretransfer ? (uint32_t)(firstByte - pretransfer) : 0;
+    data->phaseMicros[PHASE_TRANSFER] = total > firstByte ? (uint32_t)(total - firstByte) : 0;
+    data->phaseMicros[PHASE_TOTAL] = (uint32_t)total;
+}
+
+// splitmix64 finalizer: spreads the bits of a seed such as a clock reading
+uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Event loop worker: drive many transfers from one thread with curl_multi
+void* eventLoopMain(void* arg) {
+    EventLoop* loop = (EventLoop*)arg;
+    struct epoll_event events[MAX_EVENTS];
+    int running = 0;
+    int jobIndex;
+    
+    loop->multi = curl_multi_init();
+    loop->epollFd = epoll_create1(0);
+    loop->timerDeadline = -1;
+    loop->inFlight = 0;
+    loop->idleHandles = (CURL**)malloc(maxInFlight * sizeof(CURL*));
+    loop->idleCount = 0;
+    loop->paused = (Transfer**)malloc(maxInFlight * sizeof(Transfer*));
+    loop->pausedCount = 0;
+    loop->releasesSeen = 0;
+    
+    if (loop->multi == NULL || loop->epollFd < 0 || loop->idleHandles == NULL || loop->paused == NULL) {
+        jobLog("Event loop %d ERROR: Failed to initialize curl_multi/epoll\n", loop->workerID + 1);
+        if (loop->multi) {
+            curl_multi_cleanup(loop->multi);
+        }
+        if (loop->epollFd >= 0) {
+            close(loop->epollFd);
+        }
+        free(loop->idleHandles);
+        free(loop->paused);
+        // Let the other loops finish the work
+        return NULL;
+    }
+    
+    curl_multi_setopt(loop->multi, CURLMOPT_SOCKETFUNCTION, socketCallback);
+    curl_multi_setopt(loop->multi, CURLMOPT_SOCKETDATA, (void*)loop);
+    curl_multi_setopt(loop->multi, CURLMOPT_TIMERFUNCTION, timerCallback);
+    curl_multi_setopt(loop->multi, CURLMOPT_TIMERDATA, (void*)loop);
+    
+    // Multiplex a host's requests over its connections. Hosts that answer
+    // with HTTP/1.1 keep at most maxPerHost pooled connections, and libcurl
+    // holds their extra requests until one is free.
+    if (http2Mode) {
+        curl_multi_setopt(loop->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(loop->multi, CURLMOPT_MAX_CONCURRENT_STREAMS, (long)maxStreams);
+        if (maxPerHost > 0) {
+            curl_multi_setopt(loop->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)maxPerHost);
+        }
+    }
+    
+    while (1) {
+        // Admit queued jobs up to the in-flight limit while memory allows
+        // and the extraction stage keeps up
+        while (loop->inFlight < maxInFlight && budgetAdmit(BUDGET_TRY) && extractAdmit(0) &&
+               queueTryPop(loop->queue, &jobIndex)) {
+            eventLoopStart(loop, jobIndex);
+        }
+        
+        if (loop->inFlight == 0) {
+            // Nothing in flight: block until more work arrives or all work is
+            // done. With no transfers to stall, waiting on extraction is safe.
+            extractAdmit(1);
+            if (!queuePop(loop->queue, &jobIndex)) {
+                break;
+            }
+            eventLoopStart(loop, jobIndex);
+            continue;
+        }
+        
+        // Wait for socket activity or the next curl timeout. The wait is capped
+        // so jobs pushed by other workers are picked up promptly.
+        long waitMs = MAX_LOOP_WAIT_MS;
+        if (loop->timerDeadline >= 0) {
+            long untilTimer = loop->timerDeadline - monotonicMillis();
+            if (untilTimer < 0) {
+                untilTimer = 0;
+            }
+            if (untilTimer < waitMs) {
+                waitMs = untilTimer;
+            }
+        }
+        
+        int count = epoll_wait(loop->epollFd, events, MAX_EVENTS, (int)waitMs);
+        
+        for (int i = 0; i < count; i++) {
+            int flags = 0;
+            if (events[i].events & EPOLLIN) {
+                flags |= CURL_CSELECT_IN;
+            }
+            if (events[i].events & EPOLLOUT) {
+                flags |= CURL_CSELECT_OUT;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                flags |= CURL_CSELECT_ERR;
+            }
+            curl_multi_socket_action(loop->multi, events[i].data.fd, flags, &running);
+        }
+        
+        if (loop->timerDeadline >= 0 && monotonicMillis() >= loop->timerDeadline) {
+            loop->timerDeadline = -1;
+            curl_multi_socket_action(loop->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+        }
+        
+        // Collect finished transfers
+        CURLMsg* message;
+        int remaining;
+        while ((message = curl_multi_info_read(loop->multi, &remaining)) != NULL) {
+            if (message->msg != CURLMSG_DONE) {
+                continue;
+            }
+            
+            CURL* curl = message->easy_handle;
+            CURLcode res = message->data.result;
+            Transfer* transfer = NULL;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&transfer);
+            
+            curl_multi_remove_handle(loop->multi, curl);
+            
+            // A paused transfer can still time out
+            for (int p = 0; p < loop->pausedCount; p++) {
+                if (loop->paused[p] == transfer) {
+                    loop->paused[p] = loop->paused[--loop->pausedCount];
+                    break;
+                }
+            }
+            
+            jobIndex = transfer->job->threadID;
+            uint64_t delay = transferFinish(transfer, res);
+            progressJobFinished(transfer->job, delay);
+            journalJobFinished(transfer->job, delay);
+            free(transfer);
+            
+            // Keep the handle for the next job on this loop
+            loop->idleHandles[loop->idleCount++] = curl;
+            
+            loop->inFlight--;
+            if (delay > 0) {
+                queueRetry(loop->queue, jobIndex, delay);
+            } else {
+                queueJobDone(loop->queue, jobIndex);
+            }
+        }
+        
+        // Memory released here or on other loops lets paused transfers go on
+        eventLoopResume(loop);
+    }
+    
+    for (int i = 0; i < loop->idleCount; i++) {
+        curl_easy_cleanup(loop->idleHandles[i]);
+    }
+    free(loop->idleHandles);
+    free(loop->paused);
+    
+    curl_multi_cleanup(loop->multi);
+    close(loop->epollFd);
+    return NULL;
+}
+
+// Add one job to an event loop's multi handle
+int eventLoopStart(EventLoop* loop, int jobIndex) {
+    ThreadData* data = jobAt(jobIndex);
+    data->workerID = loop->workerID;
+    data->startTime = monotonicNanos();
+    progressJobStarted(data);
+    
+    Transfer* transfer = (Transfer*)calloc(1, sizeof(Transfer));
+    CURL* curl;
+    
+    if (loop->idleCount > 0) {
+        curl = loop->idleHandles[--loop->idleCount];
+        curl_easy_reset(curl);
+    } else {
+        curl = curl_easy_init();
+    }
+    
+    int failed = transfer == NULL || curl == NULL || transferSetup(transfer, curl, data) != 0;
+    if (!failed) {
+        transfer->loop = loop;
+        failed = curl_multi_add_handle(loop->multi, curl) != CURLM_OK;
+    }
+    
+    if (failed) {
+        workerLog("Event loop %d ERROR (URL %d): Failed to start transfer\n", loop->workerID + 1, data->threadID + 1);
+        data->success = 0;
+        data->endTime = monotonicNanos();
+        if (transfer) {
+            bufferRelease(storeMode == STORE_STREAM ? &stagingPool : &bodyPool, &transfer->chunk);
+            budgetRelease(transfer);
+            curl_slist_free_all(transfer->headers);
+            compressorRelease(transfer->compressor);
+        }
+        free(transfer);
+        if (curl) {
+            curl_easy_cleanup(curl);
+        }
+        progressJobFinished(data, 0);
+        queueJobDone(loop->queue, jobIndex);
+        return -1;
+    }
+    
+    loop->inFlight++;
+    return 0;
+}
+
+// Remember a transfer whose write callback paused it for want of memory
+void eventLoopPause(EventLoop* loop, Transfer* transfer) {
+    if (!transfer->paused) {
+        transfer->paused = 1;
+        loop->paused[loop->pausedCount++] = transfer;
+    }
+}
+
+// Unpause transfers, newest first, while the budget can take their next
+// chunk. Unpausing redelivers the refused data at once, so a transfer that
+// pauses again means the budget is full and the rest keep waiting. Nothing
+// is tried unless some memory was returned since the last attempt.
+void eventLoopResume(EventLoop* loop) {
+    if (loop->pausedCount == 0) {
+        return;
+    }
+    
+    pthread_mutex_lock(&budget.lock);
+    uint64_t releases = budget.releases;
+    pthread_mutex_unlock(&budget.lock);
+    if (releases == loop->releasesSeen) {
+        return;
+    }
+    loop->releasesSeen = releases;
+    
+    while (loop->pausedCount > 0) {
+        Transfer* transfer = loop->paused[--loop->pausedCount];
+        transfer->paused = 0;
+        curl_easy_pause(transfer->curl, CURLPAUSE_CONT);
+        if (transfer->paused) {
+            break;
+        }
+    }
+}
+
+// curl_multi socket callback: mirror curl's interest set into epoll
+int socketCallback(CURL* easy, curl_socket_t s, int what, void* userp, void* socketp) {
+    EventLoop* loop = (EventLoop*)userp;
+    (void)easy;
+    
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, s, NULL);
+        return 0;
+    }
+    
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.data.fd = s;
+    if (what & CURL_POLL_IN) {
+        event.events |= EPOLLIN;
+    }
+    if (what & CURL_POLL_OUT) {
+        event.events |= EPOLLOUT;
+    }
+    
+    if (socketp == NULL) {
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, s, &event);
+        curl_multi_assign(loop->multi, s, (void*)loop);
+    } else {
+        epoll_ctl(loop->epollFd, EPOLL_CTL_MOD, s, &event);
+    }
+    return 0;
+}
+
+// curl_multi timer callback: remember when curl next wants a timeout action
+int timerCallback(CURLM* multi, long timeoutMs, void* userp) {
+    EventLoop* loop = (EventLoop*)userp;
+    (void)multi;
+    
+    if (timeoutMs < 0) {
+        loop->timerDeadline = -1;
+    } else {
+        loop->timerDeadline = monotonicMillis() + timeoutMs;
+    }
+    return 0;
+}
+
+// Milliseconds from a monotonic clock
+long monotonicMillis() {
+    return (long)(monotonicNanos() / 1000000ULL);
+}
+
+// Nanoseconds from a monotonic clock
+uint64_t monotonicNanos() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// Callback function for curl to write data (memory mode)
+size_t writeCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t realsize = size * nmemb;
+    MemoryStruct* mem = (MemoryStruct*)userp;
+    
+    // Grow geometrically so large bodies are copied O(log n) times
+    if (mem->size + realsize + 1 > mem->capacity) {
+        size_t newCapacity = bufferGrowth(mem, mem->size + realsize + 1);
+        
+        char* ptr = realloc(mem->data, newCapacity);
+        if (ptr == NULL) {
+            printf("Not enough memory (realloc returned NULL)\n");
+            return 0;
+        }
+        mem->data = ptr;
+        mem->capacity = newCapacity;
+    }
+    
+    memcpy(&(mem->data[mem->size]), contents, realsize);
+    mem->size += realsize;
+    mem->data[mem->size] = 0;
+    
+    return realsize;
+}
+
+// Callback function for curl to write data (memory mode, per transfer):
+// buffer the body, hashing it and scanning it for links as it arrives.
+// Growth the memory budget can't cover blocks a worker thread, or pauses
+// the transfer on an event loop until other transfers release memory.
+size_t bodyCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t realsize = size * nmemb;
+    Transfer* transfer = (Transfer*)userp;
+    MemoryStruct* chunk = &transfer->chunk;
+    
+    if (maxBodySize > 0 && chunk->size + realsize > maxBodySize) {
+        transfer->tooLarge = 1;
+        transfer->writeFailed = 1;
+        return 0;
+    }
+    
+    // Charge growth before using the data: a paused transfer is handed the
+    // same bytes again when it resumes
+    size_t capacity = bufferGrowth(chunk, chunk->size + realsize + 1);
+    if (capacity > chunk->capacity &&
+        budgetReserve(transfer, capacity - chunk->capacity, transfer->loop != NULL ? BUDGET_TRY : BUDGET_WAIT) != 0) {
+        eventLoopPause(transfer->loop, transfer);
+        return CURL_WRITEFUNC_PAUSE;
+    }
+    
+    contentHashUpdate(transfer, contents, size * nmemb);
+    if (transfer->links.state != LINK_SCAN_OFF) {
+        linkScan(transfer, (const char*)contents, size * nmemb);
+    }
+    return writeCallback(contents, size, nmemb, &transfer->chunk);
+}
+
+// Callback function for curl to write data (stream mode): stage chunks and
+// write them straight to the output file
+size_t streamCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t realsize = size * nmemb;
+    Transfer* transfer = (Transfer*)userp;
+    MemoryStruct* staging = &transfer->chunk;
+    const char* input = (const char*)contents;
+    size_t remaining = realsize;
+    
+    if (maxBodySize > 0 && transfer->rawSize + realsize > maxBodySize) {
+        transfer->tooLarge = 1;
+        transfer->writeFailed = 1;
+        return 0;
+    }
+    
+    if (transfer->fd < 0 && streamOpen(transfer) != 0) {
+        transfer->writeFailed = 1;
+        return 0;
+    }
+    
+    transfer->rawSize += realsize;
+    contentHashUpdate(transfer, input, realsize);
+    if (transfer->links.state != LINK_SCAN_OFF) {
+        linkScan(transfer, input, realsize);
+    }
+    
+    if (transfer->compressor != NULL) {
+        if (compressStream(transfer, input, realsize, 0) != 0) {
+            transfer->writeFailed = 1;
+            return 0;
+        }
+        return realsize;
+    }
+    
+    while (remaining > 0) {
+        size_t space = staging->capacity - staging->size;
+        size_t take = remaining < space ? remaining : space;
+        
+        memcpy(staging->data + staging->size, input, take);
+        staging->size += take;
+        input += take;
+        remaining -= take;
+        
+        if (staging->size == staging->capacity && streamFlush(transfer, 0) != 0) {
+            transfer->writeFailed = 1;
+            return 0;
+        }
+    }
+    
+    return realsize;
+}
+
+// Open the temporary output file for a streamed transfer
+int streamOpen(Transfer* transfer) {
+    char tempPath[MAX_PATH_LENGTH + 8];
+    tempPathFor(transfer->outputPath, tempPath, sizeof(tempPath));
+    
+    transfer->fd = -1;
+    transfer->direct = 0;
+    
+#ifdef O_DIRECT
+    if (directIO) {
+        transfer->fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if (transfer->fd >= 0) {
+            transfer->direct = 1;
+        }
+        // Filesystems such as tmpfs reject O_DIRECT; fall back to buffered I/O
+    }
+#endif
+    
+    if (transfer->fd < 0) {
+        transfer->fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    return transfer->fd >= 0 ? 0 : -1;
+}
+
+// Write staged bytes to disk. O_DIRECT writes must be whole aligned blocks,
+// so the unaligned tail is kept until the final flush, which pads the last
+// block and trims the file back to its real length.
+int streamFlush(Transfer* transfer, int final) {
+    MemoryStruct* staging = &transfer->chunk;
+    size_t length = staging->size;
+    
+    if (length == 0) {
+        return 0;
+    }
+    
+    if (!transfer->direct) {
+        if (writeAll(transfer->fd, staging->data, length, (off_t)transfer->written) != 0) {
+            return -1;
+        }
+        transfer->written += length;
+        staging->size = 0;
+        return 0;
+    }
+    
+    size_t aligned = length - length % DIRECT_IO_ALIGN;
+    
+    if (final && aligned < length) {
+        size_t padded = aligned + DIRECT_IO_ALIGN;
+        memset(staging->data + length, 0, padded - length);
+        if (writeAll(transfer->fd, staging->data, padded, (off_t)transfer->written) != 0 ||
+            ftruncate(transfer->fd, (off_t)(transfer->written + length)) != 0) {
+            return -1;
+        }
+        transfer->written += length;
+        staging->size = 0;
+        return 0;
+    }
+    
+    if (aligned > 0) {
+        if (writeAll(transfer->fd, staging->data, aligned, (off_t)transfer->written) != 0) {
+            return -1;
+        }
+        transfer->written += aligned;
+        memmove(staging->data, staging->data + aligned, length - aligned);
+        staging->size = length - aligned;
+    }
+    return 0;
+}
+
+// pwrite an entire buffer, retrying short writes
+int writeAll(int fd, const char* buffer, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t n = pwrite(fd, buffer, length, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buffer += n;
+        length -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+// Write a complete in-memory body to its output file by way of tempPath,
+// which is private to the job even when the output file is a shared object
+int saveBody(const char* path, const char* tempPath, const char* buffer, size_t length) {
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    int failed = writeAll(fd, buffer, length, 0) != 0;
+    if (close(fd) != 0) {
+        failed = 1;
+    }
+    if (failed || rename(tempPath, path) != 0) {
+        unlink(tempPath);
+        return -1;
+    }
+    return 0;
+}
+
+// Downloads are written to "<file>.part" and renamed when complete
+void tempPathFor(const char* path, char* tempPath, size_t size) {
+    snprintf(tempPath, size, "%s.part", path);
+}
+
+// Take a buffer of at least minCapacity bytes from a pool, or allocate one.
+// Aligned buffers are fixed-size and suitable for O_DIRECT.
+int bufferAcquire(BufferPool* pool, MemoryStruct* mem, size_t minCapacity, int aligned) {
+    mem->data = NULL;
+    mem->size = 0;
+    mem->capacity = 0;
+    
+    pthread_mutex_lock(&pool->lock);
+    for (int i = pool->count - 1; i >= 0; i--) {
+        if (pool->capacities[i] >= minCapacity) {
+            mem->data = pool->buffers[i];
+            mem->capacity = pool->capacities[i];
+            pool->count--;
+            pool->buffers[i] = pool->buffers[pool->count];
+            pool->capacities[i] = pool->capacities[pool->count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    
+    if (mem->data != NULL) {
+        return 0;
+    }
+    
+    if (aligned) {
+        void* block = NULL;
+        // One spare block lets the final O_DIRECT flush pad in place
+        if (posix_memalign(&block, DIRECT_IO_ALIGN, minCapacity + DIRECT_IO_ALIGN) != 0) {
+            return -1;
+        }
+        mem->data = (char*)block;
+    } else {
+        mem->data = (char*)malloc(minCapacity);
+        if (mem->data == NULL) {
+            return -1;
+        }
+    }
+    mem->capacity = minCapacity;
+    return 0;
+}
+
+// Return a buffer to its pool; oversized buffers are freed instead
+void bufferRelease(BufferPool* pool, MemoryStruct* mem) {
+    if (mem->data == NULL) {
+        return;
+    }
+    
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count < MAX_POOLED_BUFFERS && mem->capacity <= MAX_POOLED_CAPACITY) {
+        pool->buffers[pool->count] = mem->data;
+        pool->capacities[pool->count] = mem->capacity;
+        pool->count++;
+        mem->data = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    
+    free(mem->data);
+    mem->data = NULL;
+    mem->size = 0;
+    mem->capacity = 0;
+}
+
+// Free every pooled buffer
+void bufferPoolCleanup(BufferPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    for (int i = 0; i < pool->count; i++) {
+        free(pool->buffers[i]);
+    }
+    pool->count = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Capacity a buffer grows to so that it holds needed bytes
+size_t bufferGrowth(const MemoryStruct* mem, size_t needed) {
+    size_t capacity = mem->capacity ? mem->capacity : INITIAL_BUFFER_SIZE;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+// Start a run with nothing charged against the memory budget
+void budgetReset() {
+    pthread_mutex_lock(&budget.lock);
+    budget.limit = memoryBudget;
+    budget.used = 0;
+    budget.peak = 0;
+    budget.overdrawn = 0;
+    pthread_mutex_unlock(&budget.lock);
+}
+
+// Charge bytes of buffer to a transfer. A transfer that would go over the
+// limit may overdraw it if no other transfer is; otherwise BUDGET_TRY fails
+// and BUDGET_WAIT blocks until memory is released.
+// Returns 0 once the bytes are charged, -1 if they were refused.
+int budgetReserve(Transfer* transfer, size_t bytes, int mode) {
+    pthread_mutex_lock(&budget.lock);
+    while (mode != BUDGET_FORCE && budget.limit > 0 && budget.used + bytes > budget.limit &&
+           !transfer->overdraft) {
+        if (!budget.overdrawn) {
+            budget.overdrawn = 1;
+            transfer->overdraft = 1;
+            break;
+        }
+        if (mode == BUDGET_TRY) {
+            pthread_mutex_unlock(&budget.lock);
+            return -1;
+        }
+        pthread_cond_wait(&budget.freed, &budget.lock);
+    }
+    
+    budget.used += bytes;
+    if (budget.used > budget.peak) {
+        budget.peak = budget.used;
+    }
+    transfer->budgetHeld += bytes;
+    pthread_mutex_unlock(&budget.lock);
+    return 0;
+}
+
+// Give back everything a transfer was charged
+void budgetRelease(Transfer* transfer) {
+    budgetReturn(transfer->budgetHeld, transfer->overdraft);
+    transfer->budgetHeld = 0;
+    transfer->overdraft = 0;
+}
+
+// Return charged bytes, and the overdraft if they held it, and wake anyone
+// waiting for memory
+void budgetReturn(size_t bytes, int overdraft) {
+    if (bytes == 0 && !overdraft) {
+        return;
+    }
+    
+    pthread_mutex_lock(&budget.lock);
+    budget.used -= bytes;
+    budget.releases++;
+    if (overdraft) {
+        budget.overdrawn = 0;
+    }
+    pthread_cond_broadcast(&budget.freed);
+    pthread_mutex_unlock(&budget.lock);
+}
+
+// Whether a new transfer may start: only while the budget has room.
+// BUDGET_WAIT blocks until it does.
+int budgetAdmit(int mode) {
+    pthread_mutex_lock(&budget.lock);
+    while (budget.limit > 0 && budget.used >= budget.limit) {
+        if (mode == BUDGET_TRY) {
+            pthread_mutex_unlock(&budget.lock);
+            return 0;
+        }
+        pthread_cond_wait(&budget.freed, &budget.lock);
+    }
+    pthread_mutex_unlock(&budget.lock);
+    return 1;
+}
+
+// Set up page compression: load the shared dictionary, if any.
+// Returns 0 on success, -1 if the dictionary can't be used.
+int compressInit() {
+#ifdef HAVE_ZSTD
+    if (compressMode != COMPRESS_ZSTD || zstdDictFile == NULL) {
+        return 0;
+    }
+    
+    MemoryStruct dict = {NULL, 0, 0};
+    if (readWholeFile(zstdDictFile, &dict) == 0 && dict.size > 0) {
+        zstdDict = ZSTD_createCDict(dict.data, dict.size, zstdLevel);
+    }
+    free(dict.data);
+    return zstdDict != NULL ? 0 : -1;
+#else
+    return compressMode == COMPRESS_NONE ? 0 : -1;
+#endif
+}
+
+// Free the dictionary and every pooled compression context
+void compressCleanup() {
+#ifdef HAVE_ZSTD
+    pthread_mutex_lock(&compressorPool.lock);
+    for (int i = 0; i < compressorPool.count; i++) {
+        ZSTD_freeCCtx((ZSTD_CCtx*)compressorPool.items[i]);
+    }
+    compressorPool.count = 0;
+    pthread_mutex_unlock(&compressorPool.lock);
+    
+    ZSTD_freeCDict(zstdDict);
+    zstdDict = NULL;
+#endif
+}
+
+// Take a compression context from the pool, or create one. Returns NULL
+// when pages are stored uncompressed (or on failure).
+void* compressorAcquire() {
+#ifdef HAVE_ZSTD
+    if (compressMode != COMPRESS_ZSTD) {
+        return NULL;
+    }
+    
+    ZSTD_CCtx* context = NULL;
+    pthread_mutex_lock(&compressorPool.lock);
+    if (compressorPool.count > 0) {
+        context = (ZSTD_CCtx*)compressorPool.items[--compressorPool.count];
+    }
+    pthread_mutex_unlock(&compressorPool.lock);
+    
+    if (context == NULL) {
+        context = ZSTD_createCCtx();
+        if (context == NULL) {
+            return NULL;
+        }
+        if (zstdDict != NULL) {
+            ZSTD_CCtx_refCDict(context, zstdDict);
+        } else {
+            ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, zstdLevel);
+        }
+    }
+    return context;
+#else
+    return NULL;
+#endif
+}
+
+// Return a compression context to the pool, abandoning any unfinished frame
+void compressorRelease(void* compressor) {
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx* context = (ZSTD_CCtx*)compressor;
+    if (context == NULL) {
+        return;
+    }
+    
+    ZSTD_CCtx_reset(context, ZSTD_reset_session_only);
+    pthread_mutex_lock(&compressorPool.lock);
+    if (compressorPool.count < MAX_POOLED_BUFFERS) {
+        compressorPool.items[compressorPool.count++] = context;
+        context = NULL;
+    }
+    pthread_mutex_unlock(&compressorPool.lock);
+    ZSTD_freeCCtx(context);
+#else
+    (void)compressor;
+#endif
+}
+
+// Compress streamed bytes into the staging buffer, flushing it to disk as
+// it fills. With final set, the frame is finished and every byte is staged.
+int compressStream(Transfer* transfer, const char* input, size_t length, int final) {
+#ifdef HAVE_ZSTD
+    MemoryStruct* staging = &transfer->chunk;
+    ZSTD_inBuffer in = { input, length, 0 };
+    size_t remaining;
+    
+    do {
+        ZSTD_outBuffer out = { staging->data, staging->capacity, staging->size };
+        remaining = ZSTD_compressStream2((ZSTD_CCtx*)transfer->compressor, &out, &in,
+                                         final ? ZSTD_e_end : ZSTD_e_continue);
+        if (ZSTD_isError(remaining)) {
+            return -1;
+        }
+        staging->size = out.pos;
+        
+        if (staging->size == staging->capacity && streamFlush(transfer, 0) != 0) {
+            return -1;
+        }
+    } while (in.pos < in.size || (final && remaining > 0));
+    return 0;
+#else
+    (void)transfer;
+    (void)input;
+    (void)length;
+    (void)final;
+    return -1;
+#endif
+}
+
+// Compress a whole in-memory body into packed, a buffer from the body pool
+int compressBody(void* compressor, const MemoryStruct* body, MemoryStruct* packed) {
+#ifdef HAVE_ZSTD
+    if (bufferAcquire(&bodyPool, packed, ZSTD_compressBound(body->size), 0) != 0) {
+        return -1;
+    }
+    
+    size_t size = ZSTD_compress2((ZSTD_CCtx*)compressor, packed->data, packed->capacity, body->data, body->size);
+    if (ZSTD_isError(size)) {
+        bufferRelease(&bodyPool, packed);
+        return -1;
+    }
+    packed->size = size;
+    return 0;
+#else
+    (void)compressor;
+    (void)body;
+    (void)packed;
+    return -1;
+#endif
+}
+
+// File name of one archive segment, relative to the output directory
+void archiveSegmentName(char* name, size_t size, int workerID, int sequence) {
+    snprintf(name, size, "archive-%03d-%05d.warc%s", workerID, sequence,
+             compressMode == COMPRESS_ZSTD ? ".zst" : "");
+}
+
+// Reset every writer before a run and open the pending index lines.
+// Lines left by an interrupted run are kept and merged at the end of this
+// one. Returns 0 on success, -1 if the file can't be opened.
+int archiveBegin() {
+    char path[MAX_PATH_LENGTH];
+    
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        ArchiveWriter* writer = &archiveWriters[i];
+        writer->fd = -1;
+        writer->sequence = 0;
+        writer->size = 0;
+    }
+    
+    snprintf(path, sizeof(path), "%s/%s", outputDir, ARCHIVE_PENDING_FILE);
+    archivePendingFd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    return archivePendingFd >= 0 ? 0 : -1;
+}
+
+// Finish the writer's current segment and start a new one. Existing
+// segments are never reopened, so earlier runs stay intact.
+int archiveOpenSegment(ArchiveWriter* writer, int workerID) {
+    char name[64];
+    char path[MAX_PATH_LENGTH];
+    
+    if (writer->fd >= 0) {
+        fdatasync(writer->fd);
+        close(writer->fd);
+        writer->fd = -1;
+        writer->sequence++;
+    }
+    
+    // Claim the next free sequence number
+    while (1) {
+        archiveSegmentName(name, sizeof(name), workerID, writer->sequence);
+        snprintf(path, sizeof(path), "%s/%s", outputDir, name);
+        writer->fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (writer->fd >= 0) {
+            break;
+        }
+        if (errno != EEXIST) {
+            return -1;
+        }
+        writer->sequence++;
+    }
+    
+    writer->size = 0;
+    return 0;
+}
+
+// Append one page to a worker's archive as a WARC resource record and
+// add its index line to the pending file, so the record can be found even
+// if the run never finishes. With compression on, each record is its own
+// zstd frame. Returns 0 on success, -1 on failure.
+int archiveAppend(int workerID, ThreadData* data, const MemoryStruct* body, const char* contentType, void* compressor) {
+    ArchiveWriter* writer = &archiveWriters[workerID];
+    static const char trailer[] = "\r\n\r\n";
+    
+    if (archivePendingFd < 0) {
+        return -1;
+    }
+    if ((writer->fd < 0 || writer->size >= segmentSize) && archiveOpenSegment(writer, workerID) != 0) {
+        return -1;
+    }
+    
+    // WARC-Date and a random (version 4) record ID
+    char date[32];
+    struct tm utc;
+    time_t now = time(NULL);
+    gmtime_r(&now, &utc);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    uint64_t high = mix64(monotonicNanos() ^ ((uint64_t)data->threadID << 20) ^ (uint64_t)workerID);
+    uint64_t low = mix64(high);
+    
+    size_t headerCapacity = data->urlLength + MAX_CONTENT_TYPE_LENGTH + 512;
+    char* header = (char*)malloc(headerCapacity);
+    if (header == NULL) {
+        return -1;
+    }
+    int headerLength = snprintf(header, headerCapacity,
+        "WARC/1.1\r\n"
+        "WARC-Type: resource\r\n"
+        "WARC-Record-ID: <urn:uuid:%08x-%04x-4%03x-%04x-%012llx>\r\n"
+        "WARC-Date: %s\r\n"
+        "WARC-Target-URI: %.*s\r\n"
+        "Content-Type: %.*s\r\n"
+        "Content-Length: %zu\r\n"
+        "\r\n",
+        (unsigned)(high >> 32), (unsigned)(high >> 16) & 0xffff, (unsigned)high & 0xfff,
+        (unsigned)(0x8000 | ((low >> 48) & 0x3fff)), (unsigned long long)(low & 0xffffffffffffULL),
+        date, (int)data->urlLength, data->url,
+        MAX_CONTENT_TYPE_LENGTH, contentType != NULL ? contentType : "application/octet-stream",
+        body->size);
+    
+    uint64_t offset = writer->size;
+    uint64_t length = 0;
+    int failed = 0;
+    
+    if (compressor != NULL) {
+        MemoryStruct record = {NULL, 0, 0};
+        MemoryStruct packed = {NULL, 0, 0};
+        
+        failed = bufferAcquire(&bodyPool, &record, headerLength + body->size + sizeof(trailer), 0) != 0;
+        if (!failed) {
+            memcpy(record.data, header, headerLength);
+            memcpy(record.data + headerLength, body->data, body->size);
+            memcpy(record.data + headerLength + body->size, trailer, sizeof(trailer) - 1);
+            record.size = headerLength + body->size + sizeof(trailer) - 1;
+            failed = compressBody(compressor, &record, &packed) != 0;
+        }
+        if (!failed) {
+            failed = writeAll(writer->fd, packed.data, packed.size, (off_t)offset) != 0;
+            length = packed.size;
+        }
+        bufferRelease(&bodyPool, &record);
+        bufferRelease(&bodyPool, &packed);
+    } else {
+        length = headerLength + body->size + sizeof(trailer) - 1;
+        failed = writeAll(writer->fd, header, headerLength, (off_t)offset) != 0 ||
+                 writeAll(writer->fd, body->data, body->size, (off_t)(offset + headerLength)) != 0 ||
+                 writeAll(writer->fd, trailer, sizeof(trailer) - 1, (off_t)(offset + headerLength + body->size)) != 0;
+    }
+    
+    // One write per line, so lines from different workers never interleave
+    if (!failed) {
+        char name[64];
+        archiveSegmentName(name, sizeof(name), workerID, writer->sequence);
+        int lineLength = snprintf(header, headerCapacity, "%.*s\t%s\t%llu\t%llu\n", (int)data->urlLength, data->url,
+                                  name, (unsigned long long)offset, (unsigned long long)length);
+        failed = write(archivePendingFd, header, (size_t)lineLength) != lineLength;
+    }
+    free(header);
+    
+    if (failed) {
+        // Cut off the partial record so the segment stays parseable
+        if (ftruncate(writer->fd, (off_t)offset) != 0) {
+            writer->size = segmentSize;
+        }
+        return -1;
+    }
+    
+    writer->size += length;
+    return 0;
+}
+
+// Close every segment and fold the pending lines into the URL index.
+// Returns 0 on success, -1 if the index could not be written.
+int archiveFinish() {
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        ArchiveWriter* writer = &archiveWriters[i];
+        if (writer->fd >= 0) {
+            fdatasync(writer->fd);
+            close(writer->fd);
+            writer->fd = -1;
+        }
+    }
+    if (archivePendingFd >= 0) {
+        fdatasync(archivePendingFd);
+        close(archivePendingFd);
+        archivePendingFd = -1;
+    }
+    return archiveWriteIndex();
+}
+
+// Rewrite the index as lines of "url, segment, offset, length" separated
+// by tabs and sorted by URL, so lookups can binary search it, then drop
+// the pending lines it now holds. A URL archived again replaces its older
+// entry.
+int archiveWriteIndex() {
+    char path[MAX_PATH_LENGTH];
+    char pendingPath[MAX_PATH_LENGTH];
+    char tempPath[MAX_PATH_LENGTH + 8];
+    MemoryStruct oldIndex = {NULL, 0, 0};
+    MemoryStruct newIndex = {NULL, 0, 0};
+    
+    snprintf(path, sizeof(path), "%s/%s", outputDir, ARCHIVE_INDEX_FILE);
+    snprintf(pendingPath, sizeof(pendingPath), "%s/%s", outputDir, ARCHIVE_PENDING_FILE);
+    tempPathFor(path, tempPath, sizeof(tempPath));
+    
+    if (readWholeFile(pendingPath, &newIndex) != 0) {
+        int missing = errno == ENOENT;
+        free(newIndex.data);
+        return missing ? 0 : -1;
+    }
+    if (newIndex.size == 0) {
+        free(newIndex.data);
+        unlink(pendingPath);
+        return 0;
+    }
+    
+    // Missing or unreadable old index: start a fresh one
+    readWholeFile(path, &oldIndex);
+    
+    int lineCount = 0;
+    for (size_t i = 0; i < oldIndex.size; i++) {
+        if (oldIndex.data[i] == '\n') {
+            lineCount++;
+        }
+    }
+    for (size_t i = 0; i < newIndex.size; i++) {
+        if (newIndex.data[i] == '\n') {
+            lineCount++;
+        }
+    }
+    
+    IndexLine* lines = (IndexLine*)malloc(lineCount * sizeof(IndexLine));
+    if (lines == NULL) {
+        free(oldIndex.data);
+        free(newIndex.data);
+        return -1;
+    }
+    
+    // Old lines first so a stable order puts the newest entry for a URL last
+    int count = 0;
+    const MemoryStruct* sources[2] = {&oldIndex, &newIndex};
+    for (int s = 0; s < 2; s++) {
+        size_t start = 0;
+        for (size_t i = 0; i < sources[s]->size; i++) {
+            if (sources[s]->data[i] == '\n') {
+                if (i > start && count < lineCount) {
+                    lines[count].text = sources[s]->data + start;
+                    lines[count].length = i - start + 1;
+                    lines[count].order = count;
+                    count++;
+                }
+                start = i + 1;
+            }
+        }
+    }
+    
+    qsort(lines, count, sizeof(IndexLine), compareIndexLines);
+    
+    int failed = 0;
+    FILE* file = fopen(tempPath, "w");
+    if (file == NULL) {
+        failed = 1;
+    } else {
+        for (int i = 0; i < count; i++) {
+            if (i + 1 < count && indexLineKeyCompare(&lines[i], &lines[i + 1]) == 0) {
+                continue;
+            }
+            fwrite(lines[i].text, 1, lines[i].length, file);
+        }
+        if (fclose(file) != 0 || rename(tempPath, path) != 0) {
+            unlink(tempPath);
+            failed = 1;
+        }
+    }
+    if (!failed) {
+        unlink(pendingPath);
+    }
+    
+    free(lines);
+    free(oldIndex.data);
+    free(newIndex.data);
+    return failed ? -1 : 0;
+}
+
+// Compare the URL fields of two index lines
+int indexLineKeyCompare(const IndexLine* a, const IndexLine* b) {
+    size_t lengthA = strcspn(a->text, "\t\n");
+    size_t lengthB = strcspn(b->text, "\t\n");
+    int result = memcmp(a->text, b->text, lengthA < lengthB ? lengthA : lengthB);
+    if (result != 0) {
+        return result;
+    }
+    return (lengthA > lengthB) - (lengthA < lengthB);
+}
+
+// qsort comparator: by URL, then by the order lines were gathered in
+int compareIndexLines(const void* a, const void* b) {
+    const IndexLine* x = (const IndexLine*)a;
+    const IndexLine* y = (const IndexLine*)b;
+    int result = indexLineKeyCompare(x, y);
+    return result != 0 ? result : (x->order > y->order) - (x->order < y->order);
+}
+
+// Find a URL's segment, offset and length by binary search in the sorted
+// index. segment must hold 64 bytes. Returns 0 if found, 1 otherwise.
+int archiveIndexLookup(const char* url, char* segment, unsigned long long* offset, unsigned long long* length) {
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/%s", outputDir, ARCHIVE_INDEX_FILE);
+    
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0) {
+        fprintf(stderr, "Error: no archive index at '%s'.\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 1;
+    }
+    
+    size_t size = (size_t)info.st_size;
+    const char* index = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (index == MAP_FAILED) {
+        return 1;
+    }
+    
+    IndexLine key = { url, strlen(url), 0 };
+    size_t low = 0;
+    size_t high = size;
+    int found = 0;
+    
+    while (low < high && !found) {
+        size_t start = low + (high - low) / 2;
+        while (start > low && index[start - 1] != '\n') {
+            start--;
+        }
+        size_t end = start;
+        while (end < size && index[end] != '\n') {
+            end++;
+        }
+        
+        // Compare against the URL field without relying on a terminator
+        size_t fieldLength = 0;
+        while (start + fieldLength < end && index[start + fieldLength] != '\t') {
+            fieldLength++;
+        }
+        int result = memcmp(index + start, key.text, fieldLength < key.length ? fieldLength : key.length);
+        if (result == 0) {
+            result = (fieldLength > key.length) - (fieldLength < key.length);
+        }
+        
+        if (result == 0) {
+            char line[128];
+            size_t restLength = end - start - fieldLength;
+            if (restLength < sizeof(line)) {
+                memcpy(line, index + start + fieldLength, restLength);
+                line[restLength] = '\0';
+                found = sscanf(line, "\t%63s\t%llu\t%llu", segment, offset, length) == 3;
+            }
+            break;
+        } else if (result < 0) {
+            low = end + 1;
+        } else {
+            high = start;
+        }
+    }
+    munmap((void*)index, size);
+    
+    if (!found) {
+        fprintf(stderr, "Error: '%s' is not in the archive.\n", url);
+        return 1;
+    }
+    return 0;
+}
+
+// Find the newest line for a URL among those not yet merged into the
+// index. segment must hold 64 bytes. Returns 1 if found, 0 otherwise.
+int archivePendingLookup(const char* url, char* segment, unsigned long long* offset, unsigned long long* length) {
+    char path[MAX_PATH_LENGTH];
+    MemoryStruct pending = {NULL, 0, 0};
+    size_t urlLength = strlen(url);
+    int found = 0;
+    
+    snprintf(path, sizeof(path), "%s/%s", outputDir, ARCHIVE_PENDING_FILE);
+    readWholeFile(path, &pending);
+    
+    size_t start = 0;
+    for (size_t i = 0; i < pending.size; i++) {
+        if (pending.data[i] != '\n') {
+            continue;
+        }
+        size_t lineLength = i - start;
+        if (lineLength > urlLength && pending.data[start + urlLength] == '\t' &&
+            memcmp(pending.data + start, url, urlLength) == 0 && lineLength - urlLength < 128) {
+            char line[128];
+            memcpy(line, pending.data + start + urlLength, lineLength - urlLength);
+            line[lineLength - urlLength] = '\0';
+            found |= sscanf(line, "\t%63s\t%llu\t%llu", segment, offset, length) == 3;
+        }
+        start = i + 1;
+    }
+    
+    free(pending.data);
+    return found;
+}
+
+// Print the archived body of a URL to stdout, looking it up among the
+// pending lines and then in the sorted index. Returns 0 if found, 1
+// otherwise.
+int archiveGet(const char* url) {
+    char path[MAX_PATH_LENGTH];
+    char segment[64] = "";
+    unsigned long long offset = 0;
+    unsigned long long length = 0;
+    
+    // Records not yet merged into the index are newer than anything in it
+    int found = archivePendingLookup(url, segment, &offset, &length);
+    if (!found && archiveIndexLookup(url, segment, &offset, &length) != 0) {
+        return 1;
+    }
+    
+    // Read the record, unpacking it if the segment is compressed
+    MemoryStruct record = {NULL, 0, 0};
+    snprintf(path, sizeof(path), "%s/%s", outputDir, segment);
+    int fd = open(path, O_RDONLY);
+    record.data = (char*)malloc(length > 0 ? length : 1);
+    if (fd < 0 || record.data == NULL || pread(fd, record.data, length, (off_t)offset) != (ssize_t)length) {
+        fprintf(stderr, "Error: could not read '%s'.\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(record.data);
+        return 1;
+    }
+    close(fd);
+    record.size = length;
+    
+    size_t nameLength = strlen(segment);
+    if (nameLength > 4 && strcmp(segment + nameLength - 4, ".zst") == 0) {
+        MemoryStruct unpacked = {NULL, 0, 0};
+        if (decompressFrame(record.data, record.size, &unpacked) != 0) {
+            fprintf(stderr, "Error: could not decompress the record.\n");
+            free(record.data);
+            return 1;
+        }
+        free(record.data);
+        record = unpacked;
+    }
+    
+    // The body follows the blank line that ends the WARC header
+    const char* headerEnd = findBytes(record.data, record.size, "\r\n\r\n", 4);
+    const char* lengthField = findBytes(record.data, record.size, "\r\nContent-Length:", 17);
+    if (headerEnd == NULL || lengthField == NULL || lengthField > headerEnd) {
+        fprintf(stderr, "Error: malformed archive record.\n");
+        free(record.data);
+        return 1;
+    }
+    size_t bodyStart = (size_t)(headerEnd + 4 - record.data);
+    size_t bodyLength = (size_t)strtoull(lengthField + 17, NULL, 10);
+    if (bodyLength > record.size - bodyStart) {
+        bodyLength = record.size - bodyStart;
+    }
+    
+    fwrite(record.data + bodyStart, 1, bodyLength, stdout);
+    free(record.data);
+    return 0;
+}
+
+// First occurrence of needle in a buffer that need not be NUL-terminated
+const char* findBytes(const char* haystack, size_t length, const char* needle, size_t needleLength) {
+    for (size_t i = 0; i + needleLength <= length; i++) {
+        if (memcmp(haystack + i, needle, needleLength) == 0) {
+            return haystack + i;
+        }
+    }
+    return NULL;
+}
+
+// Decompress one zstd frame into a newly allocated buffer, using the
+// --zstd-dict dictionary if one was given
+int decompressFrame(const char* data, size_t size, MemoryStruct* out) {
+#ifdef HAVE_ZSTD
+    unsigned long long contentSize = ZSTD_getFrameContentSize(data, size);
+    if (contentSize == ZSTD_CONTENTSIZE_ERROR || contentSize == ZSTD_CONTENTSIZE_UNKNOWN) {
+        return -1;
+    }
+    
+    MemoryStruct dict = {NULL, 0, 0};
+    if (zstdDictFile != NULL && readWholeFile(zstdDictFile, &dict) != 0) {
+        return -1;
+    }
+    
+    out->data = (char*)malloc(contentSize > 0 ? contentSize : 1);
+    ZSTD_DCtx* context = ZSTD_createDCtx();
+    size_t result = 0;
+    if (out->data != NULL && context != NULL) {
+        result = ZSTD_decompress_usingDict(context, out->data, contentSize, data, size, dict.data, dict.size);
+    }
+    ZSTD_freeDCtx(context);
+    free(dict.data);
+    
+    if (out->data == NULL || context == NULL || ZSTD_isError(result)) {
+        free(out->data);
+        out->data = NULL;
+        return -1;
+    }
+    out->size = result;
+    out->capacity = contentSize;
+    return 0;
+#else
+    (void)data;
+    (void)size;
+    (void)out;
+    return -1;
+#endif
+}
+
+// Read a whole file into a growable buffer. Returns 0 on success.
+int readWholeFile(const char* path, MemoryStruct* out) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    
+    char buffer[64 * 1024];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        if (writeCallback(buffer, 1, n, out) != n) {
+            break;
+        }
+    }
+    int failed = ferror(file) || n > 0;
+    fclose(file);
+    return failed ? -1 : 0;
+}
+
+// Rotate left
+uint64_t rotl64(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+// Read a little-endian 64-bit word from unaligned memory
+uint64_t readLE64(const unsigned char* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+// One XXH64 accumulator step
+uint64_t xxh64Round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+// Start an XXH64 hash (seed 0)
+void xxh64Reset(Xxh64State* state) {
+    state->lanes[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+    state->lanes[1] = XXH_PRIME64_2;
+    state->lanes[2] = 0;
+    state->lanes[3] = 0 - XXH_PRIME64_1;
+    state->totalLength = 0;
+    state->buffered = 0;
+}
+
+// Feed bytes to an XXH64 hash. Whole 32-byte stripes go straight through
+// the four lanes; a partial stripe waits in the buffer for the next call.
+void xxh64Update(Xxh64State* state, const void* data, size_t length) {
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + length;
+    state->totalLength += length;
+    
+    if (state->buffered + length < 32) {
+        memcpy(state->buffer + state->buffered, p, length);
+        state->buffered += length;
+        return;
+    }
+    
+    if (state->buffered > 0) {
+        size_t fill = 32 - state->buffered;
+        memcpy(state->buffer + state->buffered, p, fill);
+        p += fill;
+        for (int i = 0; i < 4; i++) {
+            state->lanes[i] = xxh64Round(state->lanes[i], readLE64(state->buffer + i * 8));
+        }
+        state->buffered = 0;
+    }
+    
+    while (end - p >= 32) {
+        for (int i = 0; i < 4; i++) {
+            state->lanes[i] = xxh64Round(state->lanes[i], readLE64(p + i * 8));
+        }
+        p += 32;
+    }
+    
+    memcpy(state->buffer, p, end - p);
+    state->buffered = end - p;
+}
+
+// Finish an XXH64 hash; the state is left untouched
+uint64_t xxh64Digest(const Xxh64State* state) {
+    uint64_t hash;
+    
+    if (state->totalLength >= 32) {
+        hash = rotl64(state->lanes[0], 1) + rotl64(state->lanes[1], 7) +
+               rotl64(state->lanes[2], 12) + rotl64(state->lanes[3], 18);
+        for (int i = 0; i < 4; i++) {
+            hash ^= xxh64Round(0, state->lanes[i]);
+            hash = hash * XXH_PRIME64_1 + XXH_PRIME64_4;
+        }
+    } else {
+        hash = state->lanes[2] + XXH_PRIME64_5;
+    }
+    hash += state->totalLength;
+    
+    const unsigned char* p = state->buffer;
+    size_t remaining = state->buffered;
+    while (remaining >= 8) {
+        hash ^= xxh64Round(0, readLE64(p));
+        hash = rotl64(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+        remaining -= 8;
+    }
+    if (remaining >= 4) {
+        uint32_t word;
+        memcpy(&word, p, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap32(word);
+#endif
+        hash ^= (uint64_t)word * XXH_PRIME64_1;
+        hash = rotl64(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+        remaining -= 4;
+    }
+    while (remaining > 0) {
+        hash ^= *p * XXH_PRIME64_5;
+        hash = rotl64(hash, 11) * XXH_PRIME64_1;
+        p++;
+        remaining--;
+    }
+    
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Start hashing a transfer's body
+int contentHashInit(Transfer* transfer) {
+    xxh64Reset(&transfer->hashState);
+    transfer->digest = NULL;
+    
+#ifdef HAVE_OPENSSL
+    if (casMode && casHash == CAS_HASH_SHA256) {
+        EVP_MD_CTX* context = EVP_MD_CTX_new();
+        if (context == NULL || EVP_DigestInit_ex(context, EVP_sha256(), NULL) != 1) {
+            EVP_MD_CTX_free(context);
+            return -1;
+        }
+        transfer->digest = context;
+    }
+#endif
+    return 0;
+}
+
+// Hash body bytes as they arrive
+void contentHashUpdate(Transfer* transfer, const void* data, size_t length) {
+    xxh64Update(&transfer->hashState, data, length);
+    
+#ifdef HAVE_OPENSSL
+    if (transfer->digest != NULL) {
+        EVP_DigestUpdate((EVP_MD_CTX*)transfer->digest, data, length);
+    }
+#endif
+}
+
+// Release the SHA-256 context, if any
+void contentHashFree(Transfer* transfer) {
+#ifdef HAVE_OPENSSL
+    EVP_MD_CTX_free((EVP_MD_CTX*)transfer->digest);
+#endif
+    transfer->digest = NULL;
+}
+
+// Hex name of a finished body: SHA-256 if selected, else its XXH64
+void contentHashName(Transfer* transfer, char* name, size_t size) {
+#ifdef HAVE_OPENSSL
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLength = 0;
+    
+    if (transfer->digest != NULL &&
+        EVP_DigestFinal_ex((EVP_MD_CTX*)transfer->digest, digest, &digestLength) == 1 &&
+        digestLength * 2 < size) {
+        for (unsigned int i = 0; i < digestLength; i++) {
+            snprintf(name + i * 2, size - i * 2, "%02x", digest[i]);
+        }
+        return;
+    }
+#endif
+    snprintf(name, size, "%016llx", (unsigned long long)transfer->contentHash);
+}
+
+// Point a finished transfer at its content-addressed object,
+// objects/<first two hex digits>/<rest>. storedSize is the size the body
+// takes on disk. An existing object of another size is a hash collision or
+// was cut short, and is replaced. Returns 1 if an identical body is already
+// stored, 0 if the object still has to be written, -1 on error.
+int casResolve(Transfer* transfer, uint64_t storedSize) {
+    contentHashName(transfer, transfer->objectName, sizeof(transfer->objectName));
+    
+    char directory[MAX_PATH_LENGTH];
+    int length = snprintf(directory, sizeof(directory), "%s/%s/%.2s", outputDir, CAS_DIR, transfer->objectName);
+    if (length < 0 || (size_t)length >= sizeof(directory) || makeDirectories(directory) != 0) {
+        return -1;
+    }
+    
+    length = snprintf(transfer->outputPath, sizeof(transfer->outputPath), "%s/%s%s", directory,
+                      transfer->objectName + 2, compressMode == COMPRESS_ZSTD ? ".zst" : "");
+    if (length < 0 || (size_t)length >= sizeof(transfer->outputPath)) {
+        return -1;
+    }
+    
+    struct stat info;
+    if (stat(transfer->outputPath, &info) != 0 || (uint64_t)info.st_size != storedSize) {
+        return 0;
+    }
+    return 1;
+}
+
+// Open the URL -> object manifest for appending
+void casBegin() {
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/%s", outputDir, CAS_MANIFEST_FILE);
+    casManifest = fopen(path, "a");
+    if (casManifest == NULL) {
+        jobLog("Warning: could not open %s; URL records will not be kept.\n", path);
+    }
+}
+
+// Record which object a URL's body was stored as
+void casRecord(Transfer* transfer, size_t size) {
+    ThreadData* data = transfer->job;
+    
+    pthread_mutex_lock(&casLock);
+    if (casManifest != NULL) {
+        fprintf(casManifest, "%.*s\t%s\t%zu\n", (int)data->urlLength, data->url, transfer->objectName, size);
+    }
+    pthread_mutex_unlock(&casLock);
+}
+
+// Close the manifest. Returns 0 if every record reached the file.
+int casFinish() {
+    if (casManifest == NULL) {
+        return -1;
+    }
+    int failed = ferror(casManifest) != 0;
+    if (fclose(casManifest) != 0) {
+        failed = 1;
+    }
+    casManifest = NULL;
+    return failed ? -1 : 0;
+}
+
+// Start the extraction threads and open the record file. A resumed crawl
+// appends, since pages finished before the restart already have records.
+// Returns 0 on success, -1 if the stage couldn't start.
+int extractStart() {
+    extractStage.items = (ExtractItem*)malloc(EXTRACT_QUEUE_SIZE * sizeof(ExtractItem));
+    if (extractStage.items == NULL) {
+        return -1;
+    }
+    extractStage.capacity = EXTRACT_QUEUE_SIZE;
+    extractStage.head = 0;
+    extractStage.count = 0;
+    extractStage.stopping = 0;
+    extractStage.records = 0;
+    extractStage.threadCount = 0;
+    
+    extractStage.output = fopen(extractFile, checkpointMode ? "a" : "w");
+    if (extractStage.output == NULL) {
+        return -1;
+    }
+    
+    for (int i = 0; i < extractThreads; i++) {
+        if (pthread_create(&extractStage.threads[extractStage.threadCount], NULL, extractMain, NULL) == 0) {
+            extractStage.threadCount++;
+        }
+    }
+    if (extractStage.threadCount == 0) {
+        fclose(extractStage.output);
+        extractStage.output = NULL;
+        free(extractStage.items);
+        extractStage.items = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Hand a finished page to the extraction threads. A worker thread waits
+// while the queue is full so fetching can't run unboundedly ahead of
+// parsing; an event loop must not block its other transfers, so the ring
+// grows instead (the loop stops admitting jobs until it drains, see
+// extractAdmit). The body buffer moves to the queue rather than being copied.
+void extractSubmit(Transfer* transfer) {
+    char* effective = NULL;
+    curl_easy_getinfo(transfer->curl, CURLINFO_EFFECTIVE_URL, &effective);
+    char* base = strdup(effective != NULL ? effective : transfer->job->url);
+    if (base == NULL) {
+        return;
+    }
+    
+    pthread_mutex_lock(&extractStage.lock);
+    if (transfer->loop != NULL && extractStage.count == extractStage.capacity) {
+        // Unwrap the ring into a buffer twice the size; if that fails the
+        // loop has to wait like a worker thread
+        ExtractItem* items = (ExtractItem*)malloc(2 * extractStage.capacity * sizeof(ExtractItem));
+        if (items != NULL) {
+            int first = extractStage.capacity - extractStage.head;
+            memcpy(items, extractStage.items + extractStage.head, first * sizeof(ExtractItem));
+            memcpy(items + first, extractStage.items, extractStage.head * sizeof(ExtractItem));
+            free(extractStage.items);
+            extractStage.items = items;
+            extractStage.capacity *= 2;
+            extractStage.head = 0;
+        }
+    }
+    while (extractStage.count >= (transfer->loop != NULL ? extractStage.capacity : EXTRACT_QUEUE_SIZE) &&
+           !extractStage.stopping) {
+        pthread_cond_wait(&extractStage.notFull, &extractStage.lock);
+    }
+    if (extractStage.stopping) {
+        pthread_mutex_unlock(&extractStage.lock);
+        free(base);
+        return;
+    }
+    
+    // The body keeps its memory budget charge until it has been parsed
+    ExtractItem* item = &extractStage.items[(extractStage.head + extractStage.count) % extractStage.capacity];
+    item->job = transfer->job;
+    item->body = transfer->chunk;
+    item->base = base;
+    item->budgetHeld = transfer->budgetHeld;
+    item->overdraft = transfer->overdraft;
+    extractStage.count++;
+    
+    transfer->chunk.data = NULL;
+    transfer->chunk.size = 0;
+    transfer->chunk.capacity = 0;
+    transfer->budgetHeld = 0;
+    transfer->overdraft = 0;
+    
+    pthread_cond_signal(&extractStage.notEmpty);
+    pthread_mutex_unlock(&extractStage.lock);
+}
+
+// Whether a fetch may start while extraction is on: not while the queue
+// holds EXTRACT_QUEUE_SIZE pages. Returns 0 in that case, unless wait is
+// set, which blocks until the extraction threads catch up.
+int extractAdmit(int wait) {
+    if (extractStage.items == NULL) {
+        return 1;
+    }
+    
+    pthread_mutex_lock(&extractStage.lock);
+    while (extractStage.count >= EXTRACT_QUEUE_SIZE && !extractStage.stopping) {
+        if (!wait) {
+            pthread_mutex_unlock(&extractStage.lock);
+            return 0;
+        }
+        pthread_cond_wait(&extractStage.notFull, &extractStage.lock);
+    }
+    pthread_mutex_unlock(&extractStage.lock);
+    return 1;
+}
+
+// Extraction thread: turn queued pages into records until the fetch pool
+// is done and the queue is drained
+void* extractMain(void* arg) {
+    MemoryStruct record = {NULL, 0, 0};
+    (void)arg;
+    
+    while (1) {
+        pthread_mutex_lock(&extractStage.lock);
+        while (extractStage.count == 0 && !extractStage.stopping) {
+            pthread_cond_wait(&extractStage.notEmpty, &extractStage.lock);
+        }
+        if (extractStage.count == 0) {
+            pthread_mutex_unlock(&extractStage.lock);
+            break;
+        }
+        ExtractItem item = extractStage.items[extractStage.head];
+        extractStage.head = (extractStage.head + 1) % extractStage.capacity;
+        extractStage.count--;
+        
+        // Broadcast: event loops waiting in extractAdmit take a wakeup
+        // without queueing anything, so a signal could strand a submitter
+        pthread_cond_broadcast(&extractStage.notFull);
+        pthread_mutex_unlock(&extractStage.lock);
+        
+        // Records are built outside the output lock and written whole, so
+        // lines from different threads never interleave
+        record.size = 0;
+        if (extractPage(&item, &record) == 0) {
+            pthread_mutex_lock(&extractStage.outputLock);
+            fwrite(record.data, 1, record.size, extractStage.output);
+            extractStage.records++;
+            pthread_mutex_unlock(&extractStage.outputLock);
+        }
+        
+        bufferRelease(&bodyPool, &item.body);
+        budgetReturn(item.budgetHeld, item.overdraft);
+        free(item.base);
+    }
+    
+    free(record.data);
+    return NULL;
+}
+
+// Wait for queued pages to be extracted, then close the record file.
+// Returns the number of records written, or -1 on a write error.
+int64_t extractStop() {
+    pthread_mutex_lock(&extractStage.lock);
+    extractStage.stopping = 1;
+    pthread_cond_broadcast(&extractStage.notEmpty);
+    pthread_cond_broadcast(&extractStage.notFull);
+    pthread_mutex_unlock(&extractStage.lock);
+    
+    for (int i = 0; i < extractStage.threadCount; i++) {
+        pthread_join(extractStage.threads[i], NULL);
+    }
+    extractStage.threadCount = 0;
+    free(extractStage.items);
+    extractStage.items = NULL;
+    
+    if (extractStage.output == NULL) {
+        return -1;
+    }
+    int failed = ferror(extractStage.output) != 0;
+    if (fclose(extractStage.output) != 0) {
+        failed = 1;
+    }
+    extractStage.output = NULL;
+    return failed ? -1 : (int64_t)extractStage.records;
+}
+
+// Build the JSONL record for one page: its title, meta name/content pairs,
+// resolved links and visible text. Script and style contents and comments
+// are skipped; tags separate words.
+// Returns 0 on success, -1 if memory ran out.
+int extractPage(const ExtractItem* item, MemoryStruct* record) {
+    const char* html = item->body.data != NULL ? item->body.data : "";
+    size_t length = item->body.size;
+    MemoryStruct title = {NULL, 0, 0};
+    MemoryStruct text = {NULL, 0, 0};
+    MemoryStruct meta = {NULL, 0, 0};
+    MemoryStruct links = {NULL, 0, 0};
+    CURLU* base = curl_url();
+    int failed = base == NULL || curl_url_set(base, CURLUPART_URL, item->base, 0) != CURLUE_OK;
+    size_t i = 0;
+    
+    while (!failed && i < length) {
+        if (html[i] != '<') {
+            // Plain text up to the next tag
+            const char* next = memchr(html + i, '<', length - i);
+            size_t end = next != NULL ? (size_t)(next - html) : length;
+            failed = appendDecoded(&text, html + i, end - i, 1) != 0;
+            i = end;
+            continue;
+        }
+        
+        if (length - i >= 4 && memcmp(html + i, "<!--", 4) == 0) {
+            const char* close = findBytes(html + i + 4, length - i - 4, "-->", 3);
+            i = close != NULL ? (size_t)(close - html) + 3 : length;
+            continue;
+        }
+        
+        // A '<' that can't start a tag is text
+        char after = i + 1 < length ? html[i + 1] : ' ';
+        if (!isalpha((unsigned char)after) && after != '/' && after != '!' && after != '?') {
+            failed = writeCallback("<", 1, 1, &text) != 1;
+            i++;
+            continue;
+        }
+        
+        // Tag name, then the end of the tag with quoted '>' ignored
+        size_t nameStart = i + 1 + (i + 1 < length && html[i + 1] == '/');
+        size_t nameEnd = nameStart;
+        while (nameEnd < length && isalnum((unsigned char)html[nameEnd])) {
+            nameEnd++;
+        }
+        size_t tagEnd = nameEnd;
+        char quote = 0;
+        while (tagEnd < length && (quote != 0 || html[tagEnd] != '>')) {
+            if (quote != 0 && html[tagEnd] == quote) {
+                quote = 0;
+            } else if (quote == 0 && (html[tagEnd] == '"' || html[tagEnd] == '\'')) {
+                quote = html[tagEnd];
+            }
+            tagEnd++;
+        }
+        
+        const char* name = html + nameStart;
+        size_t nameLength = nameEnd - nameStart;
+        const char* attributes = html + nameEnd;
+        size_t attributesLength = tagEnd - nameEnd;
+        int opening = nameStart == i + 1;
+        i = tagEnd < length ? tagEnd + 1 : length;
+        
+        // Tags separate words in the text
+        if (text.size > 0 && text.data[text.size - 1] != ' ') {
+            failed = writeCallback(" ", 1, 1, &text) != 1;
+        }
+        if (!opening || failed) {
+            continue;
+        }
+        
+        if (tagNameIs(name, nameLength, "script") || tagNameIs(name, nameLength, "style") ||
+            tagNameIs(name, nameLength, "title")) {
+            // Raw text runs to the matching close tag
+            char closeTag[9];
+            size_t closeLength = (size_t)snprintf(closeTag, sizeof(closeTag), "</%.*s", (int)nameLength, name);
+            size_t end = i;
+            while (end + closeLength <= length && strncasecmp(html + end, closeTag, closeLength) != 0) {
+                end++;
+            }
+            if (end + closeLength > length) {
+                end = length;
+            }
+            if (tagNameIs(name, nameLength, "title") && title.size == 0) {
+                failed = appendDecoded(&title, html + i, end - i, 1) != 0;
+            }
+            const char* close = memchr(html + end, '>', length - end);
+            i = close != NULL ? (size_t)(close - html) + 1 : length;
+        } else if (tagNameIs(name, nameLength, "meta")) {
+            const char* key;
+            const char* content;
+            size_t keyLength;
+            size_t contentLength;
+            if ((tagAttribute(attributes, attributesLength, "name", &key, &keyLength) ||
+                 tagAttribute(attributes, attributesLength, "property", &key, &keyLength)) &&
+                tagAttribute(attributes, attributesLength, "content", &content, &contentLength)) {
+                failed = (meta.size > 0 && writeCallback(",", 1, 1, &meta) != 1) ||
+                         writeCallback("{\"name\":", 1, 8, &meta) != 8 ||
+                         appendJSONString(&meta, key, keyLength) != 0 ||
+                         writeCallback(",\"content\":", 1, 11, &meta) != 11 ||
+                         appendDecodedJSON(&meta, content, contentLength) != 0 ||
+                         writeCallback("}", 1, 1, &meta) != 1;
+            }
+        } else if (tagNameIs(name, nameLength, "a")) {
+            const char* href;
+            size_t hrefLength;
+            if (tagAttribute(attributes, attributesLength, "href", &href, &hrefLength)) {
+                failed = extractLink(base, href, hrefLength, &links) != 0;
+            }
+        }
+    }
+    curl_url_cleanup(base);
+    
+    // Trim the space a trailing tag leaves
+    while (text.size > 0 && text.data[text.size - 1] == ' ') {
+        text.size--;
+    }
+    while (title.size > 0 && title.data[title.size - 1] == ' ') {
+        title.size--;
+    }
+    
+    failed = failed ||
+             writeCallback("{\"url\":", 1, 7, record) != 7 ||
+             appendJSONString(record, item->job->url, item->job->urlLength) != 0 ||
+             writeCallback(",\"title\":", 1, 9, record) != 9 ||
+             appendJSONString(record, title.data, title.size) != 0 ||
+             writeCallback(",\"meta\":[", 1, 9, record) != 9 ||
+             (meta.size > 0 && writeCallback(meta.data, 1, meta.size, record) != meta.size) ||
+             writeCallback("],\"links\":[", 1, 11, record) != 11 ||
+             (links.size > 0 && writeCallback(links.data, 1, links.size, record) != links.size) ||
+             writeCallback("],\"text\":", 1, 9, record) != 9 ||
+             appendJSONString(record, text.data, text.size) != 0 ||
+             writeCallback("}\n", 1, 2, record) != 2;
+    
+    free(title.data);
+    free(text.data);
+    free(meta.data);
+    free(links.data);
+    return failed ? -1 : 0;
+}
+
+// Whether a tag name is the given lower-case name, in any case
+int tagNameIs(const char* name, size_t length, const char* wanted) {
+    return strlen(wanted) == length && strncasecmp(name, wanted, length) == 0;
+}
+
+// Find an attribute among a tag's attributes. Quoted and unquoted values
+// are returned raw, without their quotes.
+// Returns 1 if the attribute is present with a value, else 0.
+int tagAttribute(const char* attributes, size_t length, const char* name, const char** value, size_t* valueLength) {
+    size_t i = 0;
+    
+    while (i < length) {
+        while (i < length && (isspace((unsigned char)attributes[i]) || attributes[i] == '/')) {
+            i++;
+        }
+        size_t nameStart = i;
+        while (i < length && attributes[i] != '=' && attributes[i] != '/' && !isspace((unsigned char)attributes[i])) {
+            i++;
+        }
+        size_t nameLength = i - nameStart;
+        while (i < length && isspace((unsigned char)attributes[i])) {
+            i++;
+        }
+        if (i >= length || attributes[i] != '=') {
+            if (nameLength == 0) {
+                i++;
+            }
+            continue;
+        }
+        i++;
+        while (i < length && isspace((unsigned char)attributes[i])) {
+            i++;
+        }
+        
+        size_t valueStart = i;
+        if (i < length && (attributes[i] == '"' || attributes[i] == '\'')) {
+            char quote = attributes[i++];
+            valueStart = i;
+            while (i < length && attributes[i] != quote) {
+                i++;
+            }
+        } else {
+            while (i < length && !isspace((unsigned char)attributes[i])) {
+                i++;
+            }
+        }
+        
+        if (tagNameIs(attributes + nameStart, nameLength, name)) {
+            *value = attributes + valueStart;
+            *valueLength = i - valueStart;
+            return 1;
+        }
+        i++;
+    }
+    return 0;
+}
+
+// Resolve an href against the page and add it to the JSON link list.
+// Links that don't resolve are left out.
+// Returns 0 on success, -1 if memory ran out.
+int extractLink(CURLU* base, const char* href, size_t length, MemoryStruct* links) {
+    MemoryStruct decoded = {NULL, 0, 0};
+    char* text = NULL;
+    int failed = appendDecoded(&decoded, href, length, 0) != 0;
+    
+    CURLU* url = failed ? NULL : curl_url_dup(base);
+    if (url != NULL && decoded.size > 0 && curl_url_set(url, CURLUPART_URL, decoded.data, 0) == CURLUE_OK) {
+        curl_url_set(url, CURLUPART_FRAGMENT, NULL, 0);
+        if (curl_url_get(url, CURLUPART_URL, &text, 0) == CURLUE_OK) {
+            failed = (links->size > 0 && writeCallback(",", 1, 1, links) != 1) ||
+                     appendJSONString(links, text, strlen(text)) != 0;
+        }
+    }
+    
+    curl_free(text);
+    curl_url_cleanup(url);
+    free(decoded.data);
+    return failed ? -1 : 0;
+}
+
+// Append HTML text with character references decoded. With collapse set,
+// runs of whitespace become one space, and none is added at the start.
+// Returns 0 on success, -1 if memory ran out.
+int appendDecoded(MemoryStruct* out, const char* text, size_t length, int collapse) {
+    static const struct { const char* name; const char* value; } entities[] = {
+        {"amp;", "&"}, {"lt;", "<"}, {"gt;", ">"}, {"quot;", "\""}, {"apos;", "'"}, {"nbsp;", " "}
+    };
+    
+    for (size_t i = 0; i < length; ) {
+        char utf8[4];
+        const char* piece = text + i;
+        size_t pieceLength = 1;
+        size_t consumed = 1;
+        
+        if (text[i] == '&') {
+            if (i + 2 < length && text[i + 1] == '#') {
+                // Numeric reference, written out as UTF-8
+                int hex = text[i + 2] == 'x' || text[i + 2] == 'X';
+                size_t j = i + 2 + hex;
+                unsigned long code = 0;
+                while (j < length && j - i < 12 && (hex ? isxdigit((unsigned char)text[j]) : isdigit((unsigned char)text[j]))) {
+                    code = code * (hex ? 16 : 10) + (isdigit((unsigned char)text[j]) ? text[j] - '0' : (tolower((unsigned char)text[j]) - 'a' + 10));
+                    j++;
+                }
+                if (j < length && text[j] == ';' && j > i + 2 + hex && code > 0 && code <= 0x10FFFF) {
+                    piece = utf8;
+                    pieceLength = utf8Encode((uint32_t)code, utf8);
+                    consumed = j + 1 - i;
+                }
+            } else {
+                for (size_t e = 0; e < sizeof(entities) / sizeof(entities[0]); e++) {
+                    size_t nameLength = strlen(entities[e].name);
+                    if (length - i - 1 >= nameLength && strncmp(text + i + 1, entities[e].name, nameLength) == 0) {
+                        piece = entities[e].value;
+                        consumed = nameLength + 1;
+                        break;
+                    }
+                }
+            }
+        }
+        i += consumed;
+        
+        if (collapse && pieceLength == 1 && isspace((unsigned char)piece[0])) {
+            if (out->size == 0 || out->data[out->size - 1] == ' ') {
+                continue;
+            }
+            piece = " ";
+        }
+        if (writeCallback((void*)piece, 1, pieceLength, out) != pieceLength) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Append an attribute value as a JSON string, references decoded
+int appendDecodedJSON(MemoryStruct* out, const char* text, size_t length) {
+    MemoryStruct decoded = {NULL, 0, 0};
+    int failed = appendDecoded(&decoded, text, length, 1) != 0 ||
+                 appendJSONString(out, decoded.data, decoded.size) != 0;
+    free(decoded.data);
+    return failed ? -1 : 0;
+}
+
+// Append text as a quoted JSON string
+int appendJSONString(MemoryStruct* out, const char* text, size_t length) {
+    if (writeCallback("\"", 1, 1, out) != 1) {
+        return -1;
+    }
+    
+    size_t start = 0;
+    for (size_t i = 0; i <= length; i++) {
+        unsigned char c = i < length ? (unsigned char)text[i] : 0;
+        if (i < length && c != '"' && c != '\\' && c >= 0x20) {
+            continue;
+        }
+        
+        // Copy the plain run, then the escape for this character
+        if (i > start && writeCallback((void*)(text + start), 1, i - start, out) != i - start) {
+            return -1;
+        }
+        start = i + 1;
+        if (i == length) {
+            break;
+        }
+        
+        char escape[8];
+        int escapeLength = c == '"' || c == '\\' ? snprintf(escape, sizeof(escape), "\\%c", c)
+                                                  : snprintf(escape, sizeof(escape), "\\u%04x", c);
+        if (writeCallback(escape, 1, (size_t)escapeLength, out) != (size_t)escapeLength) {
+            return -1;
+        }
+    }
+    return writeCallback("\"", 1, 1, out) == 1 ? 0 : -1;
+}
+
+// Encode a code point as UTF-8. Returns the number of bytes written.
+size_t utf8Encode(uint32_t code, char* out) {
+    if (code < 0x80) {
+        out[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800) {
+        out[0] = (char)(0xC0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000) {
+        out[0] = (char)(0xE0 | (code >> 12));
+        out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (code >> 18));
+    out[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+// Path of a checkpoint file in the output directory
+void journalPath(char* path, size_t size, const char* name) {
+    snprintf(path, size, "%s/%s", outputDir, name);
+}
+
+// Apply the records in one checkpoint file to the job list. Every URL
+// becomes a job; finished ones are marked as resumed so they aren't fetched
+// again. A torn last line from a crash is ignored. Returns records applied.
+int journalReplay(const char* path, int** table, size_t* tableSize) {
+    MemoryStruct text = {NULL, 0, 0};
+    if (readWholeFile(path, &text) != 0) {
+        return 0;
+    }
+    
+    // Size the URL lookup for every job plus one new job per line
+    size_t lines = 0;
+    for (size_t i = 0; i < text.size; i++) {
+        lines += text.data[i] == '\n';
+    }
+    size_t needed = 16;
+    while (needed < 2 * ((size_t)urlCount + lines)) {
+        needed *= 2;
+    }
+    if (needed > *tableSize) {
+        int* grown = (int*)malloc(needed * sizeof(int));
+        if (grown == NULL) {
+            free(text.data);
+            return -1;
+        }
+        memset(grown, -1, needed * sizeof(int));
+        for (int i = 0; i < urlCount; i++) {
+            size_t slot = urlKey(jobAt(i)->url, jobAt(i)->urlLength) & (needed - 1);
+            while (grown[slot] >= 0) {
+                slot = (slot + 1) & (needed - 1);
+            }
+            grown[slot] = i;
+        }
+        free(*table);
+        *table = grown;
+        *tableSize = needed;
+    }
+    
+    int applied = 0;
+    char* line = text.data;
+    char* end = text.data + text.size;
+    
+    while (line < end) {
+        char* newline = memchr(line, '\n', end - line);
+        if (newline == NULL) {
+            break;
+        }
+        *newline = '\0';
+        
+        char* value = line + 2;
+        char* url = strchr(value, '\t');
+        if ((line[0] != 'A' && line[0] != 'D') || line[1] != '\t' || url == NULL || url[1] == '\0') {
+            line = newline + 1;
+            continue;
+        }
+        url++;
+        size_t length = newline - url;
+        
+        // A seed list may hold the same URL more than once; the record
+        // applies to every copy
+        size_t slot = urlKey(url, length) & (*tableSize - 1);
+        int found = 0;
+        int index;
+        while ((index = (*table)[slot]) >= 0) {
+            ThreadData* data = jobAt(index);
+            if (data->urlLength == length && memcmp(data->url, url, length) == 0) {
+                journalApply(data, line[0], value);
+                found = 1;
+            }
+            slot = (slot + 1) & (*tableSize - 1);
+        }
+        if (!found) {
+            index = jobAppend(url, length);
+            if (index < 0) {
+                break;
+            }
+            (*table)[slot] = index;
+            journalApply(jobAt(index), line[0], value);
+        }
+        applied++;
+        line = newline + 1;
+    }
+    
+    free(text.data);
+    return applied;
+}
+
+// Apply one replayed record to a job
+void journalApply(ThreadData* data, char type, const char* value) {
+    if (type == 'A') {
+        data->depth = atoi(value);
+    } else {
+        data->dataSize = strtoull(value, NULL, 10);
+        data->success = 1;
+        data->resumed = 1;
+        data->checkpointed = 1;
+    }
+}
+
+// Restore the state of an interrupted run from the snapshot and the
+// journal written since, then start the group-commit thread. Returns the
+// number of jobs that are already done, or -1 if the journal can't be
+// opened.
+int journalOpen() {
+    char path[MAX_PATH_LENGTH];
+    int* table = NULL;
+    size_t tableSize = 0;
+    
+    memset(&journal, 0, sizeof(journal));
+    journal.fd = -1;
+    
+    // Later records win, so the journal goes on top of the snapshot
+    journalPath(path, sizeof(path), CHECKPOINT_SNAPSHOT_FILE);
+    journalReplay(path, &table, &tableSize);
+    journalPath(path, sizeof(path), CHECKPOINT_JOURNAL_FILE);
+    journalReplay(path, &table, &tableSize);
+    free(table);
+    
+    journal.fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (journal.fd < 0) {
+        return -1;
+    }
+    
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&journal.lock, NULL);
+    pthread_cond_init(&journal.wake, &attr);
+    pthread_condattr_destroy(&attr);
+    
+    journal.running = pthread_create(&journal.thread, NULL, journalMain, NULL) == 0;
+    
+    int resumed = 0;
+    for (int i = 0; i < urlCount; i++) {
+        resumed += jobAt(i)->resumed;
+    }
+    return resumed;
+}
+
+// Queue a record for the next group commit
+void journalAppend(char type, uint64_t value, const char* url, size_t length) {
+    char prefix[32];
+    int prefixLength = snprintf(prefix, sizeof(prefix), "%c\t%llu\t", type, (unsigned long long)value);
+    
+    pthread_mutex_lock(&journal.lock);
+    writeCallback(prefix, 1, prefixLength, &journal.pending);
+    writeCallback((void*)url, 1, length, &journal.pending);
+    writeCallback("\n", 1, 1, &journal.pending);
+    journal.records++;
+    if (journal.pending.size >= CHECKPOINT_FLUSH_BYTES) {
+        pthread_cond_signal(&journal.wake);
+    }
+    pthread_mutex_unlock(&journal.lock);
+}
+
+// Journal a link found by the crawler, with its depth
+void journalJobAdded(ThreadData* data) {
+    if (checkpointMode && journal.fd >= 0) {
+        journalAppend('A', (uint64_t)data->depth, data->url, data->urlLength);
+    }
+}
+
+// Journal a job that finished successfully. The snapshot only trusts
+// checkpointed, which is set after the size it reads.
+void journalJobFinished(ThreadData* data, uint64_t retryDelay) {
+    if (!checkpointMode || journal.fd < 0 || retryDelay > 0 || !data->success) {
+        return;
+    }
+    __atomic_store_n(&data->checkpointed, 1, __ATOMIC_RELEASE);
+    journalAppend('D', data->dataSize, data->url, data->urlLength);
+}
+
+// Write out what has been queued since the last commit and sync it once
+// for the whole batch. Called only from the commit thread (or after it has
+// stopped).
+int journalCommit() {
+    pthread_mutex_lock(&journal.lock);
+    MemoryStruct batch = journal.pending;
+    journal.pending = journal.writing;
+    journal.pending.size = 0;
+    pthread_mutex_unlock(&journal.lock);
+    
+    int status = 0;
+    const char* cursor = batch.data;
+    size_t remaining = batch.size;
+    while (remaining > 0) {
+        ssize_t n = write(journal.fd, cursor, remaining);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            status = -1;
+            break;
+        }
+        cursor += n;
+        remaining -= (size_t)n;
+    }
+    if (batch.size > 0 && fdatasync(journal.fd) != 0) {
+        status = -1;
+    }
+    
+    batch.size = 0;
+    journal.writing = batch;
+    return status;
+}
+
+// Compact everything known so far into a fresh snapshot, then empty the
+// journal. Records queued meanwhile go into the emptied journal, and
+// replaying a record twice is harmless, so no record can be lost.
+int journalSnapshot() {
+    char path[MAX_PATH_LENGTH];
+    char tempPath[MAX_PATH_LENGTH + 8];
+    journalPath(path, sizeof(path), CHECKPOINT_SNAPSHOT_FILE);
+    tempPathFor(path, tempPath, sizeof(tempPath));
+    
+    if (journalCommit() != 0) {
+        return -1;
+    }
+    
+    FILE* file = fopen(tempPath, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&urlLock);
+    int count = urlCount;
+    pthread_mutex_unlock(&urlLock);
+    
+    for (int i = 0; i < count; i++) {
+        ThreadData* data = jobAt(i);
+        fprintf(file, "A\t%d\t%.*s\n", __atomic_load_n(&data->depth, __ATOMIC_RELAXED),
+                (int)data->urlLength, data->url);
+        if (__atomic_load_n(&data->checkpointed, __ATOMIC_ACQUIRE)) {
+            fprintf(file, "D\t%zu\t%.*s\n", data->dataSize, (int)data->urlLength, data->url);
+        }
+    }
+    
+    if (fflush(file) != 0 || fsync(fileno(file)) != 0) {
+        fclose(file);
+        unlink(tempPath);
+        return -1;
+    }
+    if (fclose(file) != 0 || rename(tempPath, path) != 0) {
+        unlink(tempPath);
+        return -1;
+    }
+    
+    pthread_mutex_lock(&journal.lock);
+    journal.records = 0;
+    pthread_mutex_unlock(&journal.lock);
+    return ftruncate(journal.fd, 0);
+}
+
+// Group-commit thread: flush the journal every CHECKPOINT_COMMIT_MS, or
+// sooner once enough records are waiting, and compact it when it grows long
+void* journalMain(void* arg) {
+    (void)arg;
+    
+    pthread_mutex_lock(&journal.lock);
+    while (!journal.stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += CHECKPOINT_COMMIT_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        
+        while (!journal.stopping && journal.pending.size < CHECKPOINT_FLUSH_BYTES &&
+               pthread_cond_timedwait(&journal.wake, &journal.lock, &deadline) == 0) {
+        }
+        int compact = journal.records >= CHECKPOINT_SNAPSHOT_RECORDS;
+        pthread_mutex_unlock(&journal.lock);
+        
+        int status = compact ? journalSnapshot() : journalCommit();
+        if (status != 0) {
+            jobLog("Warning: could not write the checkpoint journal.\n");
+        }
+        
+        pthread_mutex_lock(&journal.lock);
+    }
+    pthread_mutex_unlock(&journal.lock);
+    return NULL;
+}
+
+// Stop the commit thread and leave a compacted snapshot behind. Returns 0
+// if the final state reached the disk.
+int journalClose() {
+    if (journal.fd < 0) {
+        return 0;
+    }
+    
+    if (journal.running) {
+        pthread_mutex_lock(&journal.lock);
+        journal.stopping = 1;
+        pthread_cond_signal(&journal.wake);
+        pthread_mutex_unlock(&journal.lock);
+        pthread_join(journal.thread, NULL);
+    }
+    
+    int status = journalSnapshot();
+    
+    close(journal.fd);
+    journal.fd = -1;
+    free(journal.pending.data);
+    free(journal.writing.data);
+    pthread_mutex_destroy(&journal.lock);
+    pthread_cond_destroy(&journal.wake);
+    return status;
+}
+
+// Display scraping results
+void displayResults() {
+    printf("\n========== SCRAPING RESULTS ==========\n");
+    
+    if (urlCount == 0) {
+        printf("No scraping results available.\n");
+        return;
+    }
+    
+    printf("%-4s %-10s %-50s %-15s %-10s\n", "ID", "Status", "URL", "Output File", "Size (KB)");
+    printf("--------------------------------------------------------------------------------------------------\n");
+    
+    for (int i = 0; i < urlCount; i++) {
+        ThreadData* data = jobAt(i);
+        char outputFile[MAX_PATH_LENGTH];
+        jobOutputPath(data, outputFile, sizeof(outputFile));
+        
+        char statusStr[10];
+        if (data->notModified) {
+            strcpy(statusStr, "UNCHANGED");
+        } else if (data->success) {
+            strcpy(statusStr, "SUCCESS");
+        } else {
+            strcpy(statusStr, "FAILED");
+        }
+        
+        // Truncate URL if too long
+        char truncatedURL[51];
+        if (data->urlLength > 47) {
+            strncpy(truncatedURL, data->url, 47);
+            truncatedURL[47] = '.';
+            truncatedURL[48] = '.';
+            truncatedURL[49] = '.';
+            truncatedURL[50] = '\0';
+        } else {
+            strcpy(truncatedURL, data->url);
+        }
+        
+        // Truncate filename if too long
+        char truncatedFile[16];
+        if (strlen(outputFile) > 12) {
+            strncpy(truncatedFile, outputFile, 12);
+            truncatedFile[12] = '.';
+            truncatedFile[13] = '.';
+            truncatedFile[14] = '.';
+            truncatedFile[15] = '\0';
+        } else {
+            strcpy(truncatedFile, outputFile);
+        }
+        
+        printf("%-4d %-10s %-50s %-15s %-10.2f\n",
+               i + 1,
+               statusStr,
+               truncatedURL,
+               truncatedFile,
+               data->dataSize / 1024.0);
+    }
+    
+    printf("==================================================================================================\n");
 }
 
 // Save URLs to file
@@ -428,9 +7314,9 @@ void saveURLsToFile() {
     }
     
     for (int i = 0; i < urlCount; i++) {
-        if (threadDataArray[i].threadID != -1) {
-            fprintf(file, "%s\n", threadDataArray[i].url);
-        }
+        ThreadData* data = jobAt(i);
+        fwrite(data->url, 1, data->urlLength, file);
+        fputc('\n', file);
     }
     
     fclose(file);
@@ -448,35 +7334,262 @@ void loadURLsFromFile() {
     fgets(filename, MAX_FILENAME, stdin);
     filename[strcspn(filename, "\n")] = 0;
     
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
+    int count = loadSeedFile(filename);
+    if (count < 0) {
         printf("Error: Could not open file '%s'.\n", filename);
         return;
     }
     
+    printf("Successfully loaded %d URLs from '%s'.\n", count, filename);
+}
+
+// Replace the job list with the URLs in a seed file, one per line. Regular
+// files are mapped and used in place; pipes and other streams are read a
+// line at a time. Lines that aren't http(s) URLs are skipped.
+// Returns the number of URLs loaded, or -1 if the file can't be read.
+int loadSeedFile(const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    
     // Clear existing URLs
-    urlCount = 0;
+    jobStoreReset();
+    
+    struct stat info;
+    int count = -1;
+    if (fstat(fileno(file), &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        count = loadSeedMapped(fileno(file), (size_t)info.st_size);
+    }
+    if (count < 0) {
+        count = loadSeedStream(file);
+    }
+    
+    fclose(file);
+    return count;
+}
+
+// Load a seed file through a private writable mapping. Scanner threads each
+// take a run of whole lines, end every line with a NUL in place and collect
+// (pointer, length) views of the valid ones, which become jobs without being
+// copied. Writing the terminators makes the kernel copy the touched pages,
+// but nothing is copied line by line in user space.
+// Returns the number of URLs loaded, or -1 to fall back to reading lines.
+int loadSeedMapped(int fd, size_t size) {
+    char* map = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t chunkCount = size / SEED_CHUNK_MIN;
+    if (chunkCount > (size_t)(cores > 0 ? cores : 1)) {
+        chunkCount = (size_t)(cores > 0 ? cores : 1);
+    }
+    if (chunkCount > MAX_SEED_THREADS) {
+        chunkCount = MAX_SEED_THREADS;
+    }
+    if (chunkCount < 1) {
+        chunkCount = 1;
+    }
+    
+    // Cut the file into equal shares, each moved forward to a line start
+    SeedChunk chunks[MAX_SEED_THREADS];
+    pthread_t threads[MAX_SEED_THREADS];
+    int started[MAX_SEED_THREADS];
+    char* end = map + size;
+    char* start = map;
+    for (size_t c = 0; c < chunkCount; c++) {
+        char* cut = c + 1 == chunkCount ? end : map + size / chunkCount * (c + 1);
+        if (cut < start) {
+            cut = start;
+        }
+        if (cut < end) {
+            char* newline = (char*)memchr(cut, '\n', (size_t)(end - cut));
+            cut = newline != NULL ? newline + 1 : end;
+        }
+        memset(&chunks[c], 0, sizeof(SeedChunk));
+        chunks[c].start = start;
+        chunks[c].end = cut;
+        start = cut;
+    }
+    
+    // The calling thread scans the first chunk itself
+    for (size_t c = 1; c < chunkCount; c++) {
+        started[c] = pthread_create(&threads[c], NULL, seedScanChunk, &chunks[c]) == 0;
+        if (!started[c]) {
+            seedScanChunk(&chunks[c]);
+        }
+    }
+    seedScanChunk(&chunks[0]);
+    
+    int failed = chunks[0].failed;
+    size_t invalid = chunks[0].invalid;
+    for (size_t c = 1; c < chunkCount; c++) {
+        if (started[c]) {
+            pthread_join(threads[c], NULL);
+        }
+        failed |= chunks[c].failed;
+        invalid += chunks[c].invalid;
+    }
+    
+    int count = 0;
+    if (!failed) {
+        seedMap = map;
+        seedMapLength = size;
+        
+        // Add every view in file order under one hold of the lock
+        int full = 0;
+        pthread_mutex_lock(&urlLock);
+        for (size_t c = 0; c < chunkCount && !full; c++) {
+            for (size_t v = 0; v < chunks[c].count; v++) {
+                if (jobInsert(chunks[c].views[v].url, chunks[c].views[v].length) < 0) {
+                    full = 1;
+                    break;
+                }
+                count++;
+            }
+        }
+        pthread_mutex_unlock(&urlLock);
+        
+        for (int i = 0; i < count; i++) {
+            dnsPrefetch(jobAt(i)->url, jobAt(i)->urlLength);
+        }
+        
+        // The last line has no newline to terminate in place, so it is copied
+        SeedView* tail = &chunks[chunkCount - 1].tail;
+        if (!full && tail->url != NULL) {
+            full = jobAppend(tail->url, tail->length) < 0;
+            count += !full;
+        }
+        
+        if (full) {
+            printf("Warning: job store full; stopped after %d URLs.\n", count);
+        }
+        if (invalid > 0) {
+            printf("Warning: skipped %zu line(s) that aren't http(s) URLs.\n", invalid);
+        }
+    }
+    
+    for (size_t c = 0; c < chunkCount; c++) {
+        free(chunks[c].views);
+    }
+    if (failed) {
+        munmap(map, size);
+        return -1;
+    }
+    return count;
+}
+
+// Seed scanner: split a chunk into lines, terminate each in place and keep
+// a view of every valid URL. memchr does the newline search, which the C
+// library runs over whole vector registers at a time.
+void* seedScanChunk(void* arg) {
+    SeedChunk* chunk = (SeedChunk*)arg;
+    char* line = chunk->start;
+    
+    while (line < chunk->end && !chunk->failed) {
+        char* newline = (char*)memchr(line, '\n', (size_t)(chunk->end - line));
+        size_t length = (size_t)((newline != NULL ? newline : chunk->end) - line);
+        if (length > 0 && line[length - 1] == '\r') {
+            length--;
+        }
+        
+        if (length == 0) {
+            // Blank lines are skipped silently
+        } else if (!seedLineValid(line, length)) {
+            chunk->invalid++;
+        } else if (newline == NULL) {
+            chunk->tail.url = line;
+            chunk->tail.length = (uint32_t)length;
+        } else {
+            if (chunk->count == chunk->capacity) {
+                size_t capacity = chunk->capacity ? chunk->capacity * 2 : 1024;
+                SeedView* views = (SeedView*)realloc(chunk->views, capacity * sizeof(SeedView));
+                if (views == NULL) {
+                    chunk->failed = 1;
+                    break;
+                }
+                chunk->views = views;
+                chunk->capacity = capacity;
+            }
+            line[length] = '\0';
+            chunk->views[chunk->count].url = line;
+            chunk->views[chunk->count].length = (uint32_t)length;
+            chunk->count++;
+        }
+        
+        if (newline == NULL) {
+            break;
+        }
+        line = newline + 1;
+    }
+    return NULL;
+}
+
+// Whether a seed line is worth a job: an http(s) URL of sane length with no
+// whitespace or control characters. Eight bytes are checked at a time: a
+// byte below 0x21 or equal to 0x7F sets its top bit in the flags word.
+int seedLineValid(const char* line, size_t length) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    size_t i = 0;
     
-    char line[MAX_URL_LENGTH];
+    if (length >= MAX_URL_LENGTH ||
+        !((length > 7 && strncasecmp(line, "http://", 7) == 0) ||
+          (length > 8 && strncasecmp(line, "https://", 8) == 0))) {
+        return 0;
+    }
+    
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, line + i, 8);
+        uint64_t del = word ^ (ones * 0x7F);
+        uint64_t flags = ((word - ones * 0x21) & ~word) | ((del - ones) & ~del);
+        if (flags & highs) {
+            return 0;
+        }
+    }
+    for (; i < length; i++) {
+        unsigned char c = (unsigned char)line[i];
+        if (c <= ' ' || c == 0x7F) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Load a seed file that can't be mapped, one line at a time.
+// Returns the number of URLs loaded.
+int loadSeedStream(FILE* file) {
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t length;
     int count = 0;
+    size_t invalid = 0;
     
-    while (fgets(line, MAX_URL_LENGTH, file) != NULL && urlCount < MAX_URLS) {
-        line[strcspn(line, "\n")] = 0;
+    while ((length = getline(&line, &lineCapacity, file)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            length--;
+        }
         
-        if (strlen(line) > 0) {
-            strcpy(threadDataArray[urlCount].url, line);
-            threadDataArray[urlCount].threadID = urlCount;
-            sprintf(threadDataArray[urlCount].outputFile, "%s/page_%d.html", OUTPUT_DIR, urlCount + 1);
-            threadDataArray[urlCount].success = 0;
-            threadDataArray[urlCount].dataSize = 0;
-            urlCount++;
+        if (length > 0 && !seedLineValid(line, (size_t)length)) {
+            invalid++;
+        } else if (length > 0) {
+            if (jobAppend(line, (size_t)length) < 0) {
+                printf("Warning: job store full; stopped after %d URLs.\n", count);
+                break;
+            }
             count++;
         }
     }
     
-    fclose(file);
-    
-    printf("Successfully loaded %d URLs from '%s'.\n", count, filename);
+    if (invalid > 0) {
+        printf("Warning: skipped %zu line(s) that aren't http(s) URLs.\n", invalid);
+    }
+    free(line);
+    return count;
 }
 
 // Display menu